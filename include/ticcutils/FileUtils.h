@@ -74,6 +74,28 @@ namespace TiCC {
     tmp_stream operator=( const tmp_stream& ) = delete;
   };
 
+  /// a class to map a whole file read-only into memory
+  class mapped_file {
+  public:
+    explicit mapped_file( const std::string& );
+    ~mapped_file();
+    const char *data() const
+    /// return the start of the mapped file
+    { return _data; };
+    size_t size() const
+    /// return the size of the mapped file
+    { return _size; };
+    const std::string& name() const
+    /// return the name of the mapped file
+    { return _name; };
+  private:
+    std::string _name;
+    const char *_data;
+    size_t _size;
+    mapped_file( const mapped_file& ) = delete;
+    mapped_file operator=( const mapped_file& ) = delete;
+  };
+
 }
 
 #endif // TICC_FILE_UTILS_H
@@ -38,6 +38,7 @@
 
 enum LogLevel{ LogSilent, LogNormal, LogDebug, LogHeavy, LogExtreme };
 enum LogFlag { NoStamp=0, StampTime=1, StampMessage=2, StampBoth=3 };
+enum LogFormat { LogText, LogJson, LogBinary, LogRingOnly };
 
 /// \brief a specialization of std::basic_streambuf for logging purposes
 template <class charT, class traits = std::char_traits<charT> >
@@ -69,6 +70,7 @@ template <class charT, class traits = std::char_traits<charT> >
  protected:
   int sync();
   int overflow( int );
+  std::streamsize xsputn( const charT *, std::streamsize );
  private:
   std::basic_ostream<charT,traits> *ass_stream;
   LogFlag stamp_flag;
@@ -95,16 +97,43 @@ inline long millitm() {
   return tp.tv_usec/1000;
 }
 
+inline size_t time_stamp( char *buf ){
+  /// write a time stamp like 20260101:120000:123: in buf
+  /*!
+    \param buf a buffer of at least 64 characters
+    \return the length of the stamp
+    The date and time part is cached per thread, and only rendered again
+    when the second changes.
+  */
+  struct stamp_cache {
+    time_t seconds = -1;
+    char line[50];
+    size_t len = 0;
+  };
+  static thread_local stamp_cache cache;
+  struct timeval tp;
+  gettimeofday(&tp,NULL);
+  if ( tp.tv_sec != cache.seconds ){
+    time_t lTime = tp.tv_sec;
+    struct tm tmp;
+    const struct tm *curtime = localtime_r(&lTime,&tmp);
+    cache.len = strftime( cache.line, 45, "%Y%m%d:%H%M%S:", curtime );
+    cache.seconds = tp.tv_sec;
+  }
+  memcpy( buf, cache.line, cache.len );
+  long milli = tp.tv_usec/1000;
+  char *p = buf + cache.len;
+  *p++ = '0' + milli / 100;
+  *p++ = '0' + milli / 10 % 10;
+  *p++ = '0' + milli % 10;
+  *p++ = ':';
+  return p - buf;
+}
+
 inline std::string time_stamp(){
-  char time_line[50];
-  time_t lTime;
-  time(&lTime);
-  struct tm tmp;
-  const struct tm *curtime = localtime_r(&lTime,&tmp);
-  strftime( time_line, 45, "%Y%m%d:%H%M%S", curtime );
-  std::string milli_line = std::to_string( millitm() );
-  milli_line = TiCC::pad( milli_line, 3, '0' );
-  return std::string(time_line)+ ":" + milli_line + ":";
+  char time_line[64];
+  size_t len = time_stamp( time_line );
+  return std::string( time_line, len );
 }
 
 /// for a derived output stream, we must provide implementations for
@@ -112,8 +141,12 @@ inline std::string time_stamp(){
 /// both use a helper function buffer_out to do the real work.
 template <class charT, class traits >
 int basic_log_buffer<charT,traits>::overflow( int c ) {
+  if ( level < threshold_level ){
+    // suppressed
+    return c;
+  }
   buffer_out();
-  if ( level >= threshold_level && c != '\r' ){
+  if ( c != '\r' ){
     //    std::cerr << "overflow OK: " << level << " >= " << threshold_level
     //	      << "(" << char(c) << ")" << std::endl;
     if ( c != EOF ){
@@ -127,6 +160,29 @@ int basic_log_buffer<charT,traits>::overflow( int c ) {
   return c;
 }
 
+/// writing a whole string at once, instead of character by character
+template <class charT, class traits >
+std::streamsize basic_log_buffer<charT,traits>::xsputn( const charT *s,
+							std::streamsize n ){
+  if ( level < threshold_level || n <= 0 ){
+    // suppressed
+    return n;
+  }
+  buffer_out();
+  const charT *end = s + n;
+  while ( s < end ){
+    // skip all '\r' characters
+    const charT *cr = traits::find( s, end - s, charT('\r') );
+    if ( !cr ){
+      ass_stream->write( s, end - s );
+      break;
+    }
+    ass_stream->write( s, cr - s );
+    s = cr + 1;
+  }
+  return n;
+}
+
 template <class charT, class traits >
 int basic_log_buffer<charT,traits>::sync() {
   ass_stream->flush();
@@ -144,7 +200,9 @@ void basic_log_buffer<charT,traits>::buffer_out(){
       // that is: when we have had a newline and NOT when we just
       // overflowed due to a long line
       if ( stamp_flag & StampTime ){
-	*ass_stream << time_stamp();
+	char stamp[64];
+	size_t len = time_stamp( stamp );
+	ass_stream->write( stamp, len );
       }
       if ( !ass_mess.empty() && ( stamp_flag & StampMessage ) ){
 	*ass_stream << ass_mess << ":";
@@ -28,6 +28,7 @@
 
 #include <iostream>
 #include <string>
+#include <cstdint>
 #include "ticcutils/LogBuffer.h"
 
 namespace TiCC {
@@ -36,19 +37,35 @@ namespace TiCC {
   /// programs.
   ///
   /// LogStream used mutexes to assure that output from different threads is
-  /// not mangled
+  /// not mangled.
+  /// In async mode, every thread formats into a buffer of its own, and the
+  /// complete records are written to the associated stream by a background
+  /// thread. So logging threads don't wait for each other, nor for the output.
+  /// With a LogFormat other than LogText, every Log scope gives a
+  /// structured record (JSON or binary) with the level, thread, time and
+  /// text. These records are also kept in a ring buffer per thread.
   class LogStream : public std::ostream {
     friend bool IsActive( LogStream & );
     friend bool IsActive( LogStream * );
+    friend class Log;
+    friend class Dbg;
+    friend class xDbg;
+    friend class xxDbg;
   public:
     explicit LogStream();
     explicit LogStream( int );
     LogStream( std::ostream&,
 	       LogFlag = StampBoth );
     LogStream( const LogStream * );
+    ~LogStream();
     LogStream *create( const std::string&, std::ios_base::openmode = std::ios::out );
     bool set_single_threaded_mode();
     bool single_threaded() const { return single_threaded_mode; };
+    bool set_async_mode( bool = true );
+    bool async() const { return async_mode; };
+    void async_flush();
+    bool set_format( LogFormat );
+    LogFormat get_format() const { return log_format; };
     void set_threshold( LogLevel t ){ buf.Threshold( t ); };
     LogLevel get_threshold() const { return buf.Threshold(); };
     void set_level( LogLevel l ){ buf.Level( l ); };
@@ -67,11 +84,34 @@ namespace TiCC {
     LogStream& operator=( const LogStream& ) = delete;
     bool IsBlocking();
     bool single_threaded_mode;
+    bool async_mode;
+    LogFormat log_format;
+    uint64_t async_id;
+    struct async_proxy;
+    async_proxy *my_proxy;
+    LogStream *thread_proxy();
+    LogStream *open_scope( LogLevel, LogLevel& );
+    void close_scope( LogLevel );
+    void write_record( std::string&& );
   };
 
   bool IsActive( LogStream & );
   bool IsActive( LogStream * );
 
+  inline bool IsActive( const LogStream& ls, LogLevel l ){
+    /// would a Log scope with threshold l on this stream give output?
+    return ls.get_level() >= l && !ls.bad();
+  }
+
+  inline bool IsActive( const LogStream *ls, LogLevel l ){
+    /// would a Log scope with threshold l on this stream give output?
+    return ls && IsActive( *ls, l );
+  }
+
+  void set_log_ring_size( size_t );
+  void dump_log_rings( std::ostream& );
+  bool install_log_crash_handler();
+
   /// \brief create a LogStream
   class Log {
   public:
@@ -129,4 +169,22 @@ namespace TiCC {
   };
 
 }
+
+/// Log, Dbg, xDbg and xxDbg only when the stream's level is high enough.
+/// Otherwise the output operands are not evaluated, and no locks taken:
+///
+///   TICC_DBG( ls ) << "expensive " << dump() << std::endl;
+///
+/// the argument may be a LogStream or a pointer to one
+#define TICC_LOG_LEVEL_( ls, level, scope )				\
+  for ( bool ticc_log_active_ = TiCC::IsActive( ls, level );		\
+	ticc_log_active_;						\
+	ticc_log_active_ = false )					\
+    *TiCC::scope( ls )
+
+#define TICC_LOG( ls ) TICC_LOG_LEVEL_( ls, LogNormal, Log )
+#define TICC_DBG( ls ) TICC_LOG_LEVEL_( ls, LogDebug, Dbg )
+#define TICC_XDBG( ls ) TICC_LOG_LEVEL_( ls, LogHeavy, xDbg )
+#define TICC_XXDBG( ls ) TICC_LOG_LEVEL_( ls, LogExtreme, xxDbg )
+
 #endif
@@ -28,9 +28,14 @@
 #define TICC_STRING_OPS_H
 
 #include <cstddef>
+#include <charconv>
+#include <locale>
+#include <type_traits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <iterator>
 #include <typeinfo>
 #include <vector>
 
@@ -41,10 +46,18 @@ namespace TiCC {
 
   std::string pad( const std::string&, size_t, const char = ' ' );
 
+  // in-place and output buffer variants, which don't allocate
+  void trim_inplace( std::string&, const std::string& = " \t\r\n" );
+  void trim_front_inplace( std::string&, const std::string& = " \t\r\n" );
+  void trim_back_inplace( std::string&, const std::string& = " \t\r\n" );
+  void pad_inplace( std::string&, size_t, const char = ' ' );
+
   void to_lower( std::string& );
   void to_upper( std::string& );
   std::string lowercase( const std::string& );
   std::string uppercase( const std::string& );
+  void lowercase_into( const std::string&, std::string& );
+  void uppercase_into( const std::string&, std::string& );
 
   bool match_front( const std::string&, const std::string& );
   bool match_back( const std::string&, const std::string& );
@@ -73,8 +86,94 @@ namespace TiCC {
   std::vector<std::string> split( const std::string& s,
 				  size_t num = 0 );
 
+  // zero-copy variants. The results are views into the input string
+  size_t split( const std::string_view&,
+		std::vector<std::string_view>&,
+		size_t = 0 );
+  size_t split_at( const std::string_view&,
+		   std::vector<std::string_view>&,
+		   const std::string_view&,
+		   size_t = 0 );
+  size_t split_at_first_of( const std::string_view&,
+			    std::vector<std::string_view>&,
+			    const std::string_view&,
+			    size_t = 0 );
+  size_t split_exact( const std::string_view&,
+		      std::vector<std::string_view>&,
+		      size_t = 0 );
+  size_t split_exact_at( const std::string_view&,
+			 std::vector<std::string_view>&,
+			 const std::string_view&,
+			 size_t = 0 );
+  size_t split_exact_at_first_of( const std::string_view&,
+				  std::vector<std::string_view>&,
+				  const std::string_view&,
+				  size_t = 0 );
+
+  /// \brief split a string lazily, one part at a time
+  ///
+  /// No vector is built: the parts are produced as string_views into the
+  /// input while iterating. e.g.
+  ///
+  ///     for ( const auto& field : StringSplitter( line, "\t" ) ){ ... }
+  class StringSplitter {
+  public:
+    enum split_mode { AT_FIRST_OF, AT };
+    explicit StringSplitter( const std::string_view&,
+			     const std::string_view& = " \r\t\n",
+			     split_mode = AT_FIRST_OF,
+			     bool = false );
+    /// \brief an input iterator over the parts of a StringSplitter
+    class iterator {
+      friend class StringSplitter;
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const std::string_view*;
+      using reference = const std::string_view&;
+      reference operator*() const { return _current; };
+      pointer operator->() const { return &_current; };
+      iterator& operator++() { advance(); return *this; };
+      iterator operator++(int) { iterator tmp = *this; advance(); return tmp; };
+      bool operator==( const iterator& other ) const {
+	return _done == other._done
+	  && ( _done || ( _pos == other._pos
+			  && _current.data() == other._current.data() ) );
+      };
+      bool operator!=( const iterator& other ) const {
+	return !( *this == other );
+      };
+    private:
+      iterator( const StringSplitter *sp, bool done ):
+	_splitter( sp ), _pos( 0 ), _done( done ) {
+	if ( !_done ){
+	  advance();
+	}
+      };
+      void advance();
+      const StringSplitter *_splitter;
+      std::string_view::size_type _pos; //!< start of the next part
+      std::string_view _current;
+      bool _done;
+    };
+    iterator begin() const { return iterator( this, false ); };
+    iterator end() const { return iterator( this, true ); };
+  private:
+    std::string_view _src;
+    std::string_view _seps;
+    bool _first_of;
+    bool _exact;
+  };
+
   std::string join( const std::vector<std::string>&,
 		    const std::string& = " " );
+  void join_into( std::string&,
+		  const std::vector<std::string>&,
+		  const std::string& = " " );
+  void join_into( std::string&,
+		  const std::vector<std::string_view>&,
+		  const std::string& = " " );
 
   std::string format_non_printable( const std::string& );
   inline std::string format_nonascii( const std::string& val ){
@@ -82,60 +181,222 @@ namespace TiCC {
     return format_non_printable( val );
   }
 
+  /// @cond HIDDEN
+  // the numeric types std::from_chars (and std::to_chars) can handle
   template< typename T >
-    inline T stringTo( const std::string& str ) {
-    T result;
-    std::stringstream dummy ( str );
-    if ( !( dummy >> result ) ) {
-      throw( std::runtime_error( "conversion from string '" + str + "' to type:"
-				 + typeid(result).name() + " failed" ) );
+    inline constexpr bool is_char_type_v =
+    std::is_same_v<T,char> || std::is_same_v<T,signed char>
+    || std::is_same_v<T,unsigned char> || std::is_same_v<T,wchar_t>
+    || std::is_same_v<T,char16_t> || std::is_same_v<T,char32_t>;
+
+  template< typename T >
+    inline constexpr bool from_chars_type_v =
+    ( std::is_integral_v<T> && !std::is_same_v<T,bool>
+      && !is_char_type_v<T> )
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    || std::is_floating_point_v<T>
+#endif
+    ;
+
+  enum class fast_result { OK, FAILED, UNSURE };
+
+  template< typename T >
+    inline fast_result fast_stringTo( const std::string_view& str, T& result ){
+    // try to convert str using std::from_chars. It must accept exactly
+    // what operator>> accepts, so for anything out of the ordinary, we
+    // answer UNSURE, and let the stream decide.
+    const char *p = str.data();
+    const char *end = p + str.size();
+    // operator>> skips leading whitespace
+    while ( p < end && ( *p == ' ' || ( *p >= '\t' && *p <= '\r' ) ) ){
+      ++p;
     }
-    return result;
+    if ( p == end
+	 || !( ( *p >= '0' && *p <= '9' ) || *p == '+' || *p == '-'
+	       || ( std::is_floating_point_v<T> && *p == '.' ) ) ){
+      // this can't be the start of a number, for the stream neither
+      return fast_result::FAILED;
+    }
+    if ( *p == '+' ){
+      // from_chars doesn't know about a plus sign
+      ++p;
+      if ( p < end && ( *p == '-' || *p == '+' ) ){
+	return fast_result::UNSURE;
+      }
+    }
+    if constexpr ( std::is_floating_point_v<T> ){
+      // only plain numbers: from_chars also takes 'inf' and 'nan'
+      const char *q = ( p < end && *p == '-' ) ? p + 1 : p;
+      if ( q == end || !( ( *q >= '0' && *q <= '9' ) || *q == '.' ) ){
+	return fast_result::UNSURE;
+      }
+    }
+    T tmp;
+    auto [ptr, ec] = std::from_chars( p, end, tmp );
+    if ( ec != std::errc() ){
+      // also out of range. The stream knows how to handle those
+      return fast_result::UNSURE;
+    }
+    if constexpr ( std::is_floating_point_v<T> ){
+      if ( ptr < end && ( *ptr == 'e' || *ptr == 'E' ) ){
+	// a dangling exponent, like "1e", which the stream rejects
+	return fast_result::UNSURE;
+      }
+    }
+    // trailing garbage is ignored, as the stream does
+    result = tmp;
+    return fast_result::OK;
   }
 
-  template<>
-    inline bool stringTo<bool>( const std::string& str ) {
+  inline bool stringTo_bool( const std::string& str, bool& result ){
     std::string b = TiCC::uppercase( str );
     if ( b == "YES" || b == "TRUE" || b == "1" ){
+      result = true;
       return true;
     }
     else if ( b == "FALSE" || b == "NO" || b == "0" ) {
-      return false;
+      result = false;
+      return true;
+    }
+    return false;
+  }
+
+  template< typename T >
+    inline size_t fast_toString( const T& value, char *buf, size_t size ){
+    // format value into buf using std::to_chars, exactly like operator<<
+    // would do with the default flags.
+    // returns the number of chars used, or 0 when the stream must decide
+    if ( std::locale() != std::locale::classic() ){
+      // the stream uses the global locale (think digit grouping),
+      // to_chars doesn't
+      return 0;
+    }
+    std::to_chars_result res;
+    if constexpr ( std::is_floating_point_v<T> ){
+      // the stream default is like printf's "%g"
+      res = std::to_chars( buf, buf + size, value,
+			   std::chars_format::general, 6 );
     }
     else {
+      res = std::to_chars( buf, buf + size, value );
+    }
+    if ( res.ec != std::errc() ){
+      return 0;
+    }
+    return res.ptr - buf;
+  }
+  /// @endcond
+
+  template< typename T >
+    inline bool stringTo( const std::string_view& str, T& result ) {
+    /// convert a string to a value of type T, without throwing
+    /*!
+      \param str the string to convert
+      \param result the value, only set on succes
+      \return true on succes
+
+      Accepts exactly the same as operator>> would. Numbers are parsed with
+      std::from_chars, when possible, and always in the classic "C" locale,
+      whatever the global locale is.
+    */
+    if constexpr ( std::is_same_v<T,bool> ){
+      return stringTo_bool( std::string( str ), result );
+    }
+    else {
+      if constexpr ( from_chars_type_v<T> ){
+	fast_result res = fast_stringTo( str, result );
+	if ( res != fast_result::UNSURE ){
+	  return res == fast_result::OK;
+	}
+      }
+      T tmp;
+      std::stringstream dummy ( ( std::string( str ) ) );
+      if constexpr ( std::is_arithmetic_v<T> ){
+	// like from_chars
+	dummy.imbue( std::locale::classic() );
+      }
+      if ( !( dummy >> tmp ) ) {
+	return false;
+      }
+      result = tmp;
+      return true;
+    }
+  }
+
+  template< typename T >
+    inline bool stringTo( const char *str, T& result ) {
+    // otherwise the const char* versions would be ambiguous
+    return stringTo( std::string_view( str ), result );
+  }
+
+  template< typename T >
+    inline T stringTo( const std::string& str ) {
+    T result;
+    if ( !stringTo( std::string_view( str ), result ) ) {
+      throw( std::runtime_error( "conversion from string '" + str + "' to type:"
+				 + typeid(result).name() + " failed" ) );
+    }
+    return result;
+  }
+
+  template<>
+    inline bool stringTo<bool>( const std::string& str ) {
+    bool result;
+    if ( !stringTo_bool( str, result ) ){
       throw( std::runtime_error( "conversion from string '"
 				 + str + "' to type:bool failed" ) );
     }
+    return result;
   }
 
   template< typename T >
     inline bool stringTo( const std::string& str, T& result ) {
-    try {
-      result = stringTo<T>( str );
-      return true;
+    if constexpr ( std::is_arithmetic_v<T> ){
+      return stringTo( std::string_view( str ), result );
     }
-    catch( ... ){
-     return false;
+    else {
+      // other types may have their own specialization of stringTo<T>()
+      try {
+	result = stringTo<T>( str );
+	return true;
+      }
+      catch( ... ){
+	return false;
+      }
     }
   }
 
   template <typename T>
     inline bool stringTo( const std::string& s, T &answer, T low, T upp ){
-    try {
-      T tmp = stringTo<T>( s );
-      if ( (tmp >= low) && (tmp <= upp) ){
-	answer = tmp;
-	return true;
-      }
-      return false;
-    }
-    catch(...){
-      return false;
+    T tmp;
+    if ( stringTo( s, tmp )
+	 && (tmp >= low) && (tmp <= upp) ){
+      answer = tmp;
+      return true;
     }
+    return false;
   }
 
   template< typename T >
     inline std::string toString ( const T& obj, bool=false ) {
+    /// convert obj to a string, using the output operator for T
+    /*!
+      \param obj the object to convert
+      \return the string representation
+
+      Numbers are formatted with std::to_chars, when possible, giving the
+      same result as operator<< would.
+    */
+    if constexpr ( std::is_same_v<T,bool> ){
+      return obj ? "1" : "0";
+    }
+    else if constexpr ( from_chars_type_v<T> ){
+      char buf[64];
+      size_t len = fast_toString( obj, buf, sizeof(buf) );
+      if ( len > 0 ){
+	return std::string( buf, len );
+      }
+    }
     std::stringstream dummy;
     if ( !( dummy << obj ) ) {
       throw( std::runtime_error( std::string("conversion from type:")
@@ -144,6 +405,31 @@ namespace TiCC {
    return dummy.str();
   }
 
+  template< typename T >
+    inline void append_to_string( std::string& out, const T& obj ) {
+    /// append the string representation of obj to out
+    /*!
+      \param out the string to append to
+      \param obj the object to convert
+
+      The same as out += toString( obj ), but numbers are formatted directly
+      into out, without a temporary string.
+    */
+    if constexpr ( std::is_same_v<T,bool> ){
+      out += obj ? '1' : '0';
+      return;
+    }
+    else if constexpr ( from_chars_type_v<T> ){
+      char buf[64];
+      size_t len = fast_toString( obj, buf, sizeof(buf) );
+      if ( len > 0 ){
+	out.append( buf, len );
+	return;
+      }
+    }
+    out += toString( obj );
+  }
+
   std::string basename( const std::string& );
   std::string dirname( const std::string& );
   std::string realpath( const std::string& );
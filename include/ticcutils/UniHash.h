@@ -28,15 +28,25 @@
 #ifndef TICC_UNITREE_H
 #define TICC_UNITREE_H
 
+#include <cstdint>
 #include <vector>
+#include <deque>
 #include <ostream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
 #include "ticcutils/Unicode.h"
 
+namespace TiCC {
+  class mapped_file;
+}
+
 namespace Hash {
 
-  /// \brief UniInfo is a structure used by UnicodeHash to store a
-  /// UnicodeString and an unique ID
+  /// \brief UniInfo is a structure to store a UnicodeString and an unique ID
   class UniInfo {
     friend std::ostream& operator<< ( std::ostream&, const UniInfo& );
   public:
@@ -68,13 +78,28 @@ namespace Hash {
     }
   };
 
+  /// a view on the characters of a string stored in a UnicodeHash
+  using UniView = std::basic_string_view<UChar>;
+
+  // Custom hasher for UniView
+  struct UniViewHash {
+    std::size_t operator()(const UniView& k) const {
+      return std::hash<std::string_view>()
+	( std::string_view( reinterpret_cast<const char*>(k.data()),
+			    k.size() * sizeof(UChar) ) );
+    }
+  };
+
   /// \brief The UnicodeHash class is used to enumerate Unicode strings.
   ///
   /// Every string gets an UNIQUE id assigned.
   ///
   /// It also keeps a reverse index from the id back to the string.
   ///
-  /// Internally it uses a std::unordered_map for fast inserting en retrieving
+  /// The characters of the strings are stored only once, in large blocks
+  /// (an arena). The reverse index holds read-only UnicodeStrings aliasing
+  /// that arena, and an open addressing table of ID's is used for fast
+  /// inserting and retrieving. This avoids an allocation per string.
   class UnicodeHash {
     friend std::ostream& operator << ( std::ostream&, const UnicodeHash& );
   public:
@@ -88,15 +113,156 @@ namespace Hash {
     };
     unsigned int hash( const icu::UnicodeString& );
     unsigned int lookup( const icu::UnicodeString& ) const;
+    void hash_batch( const std::vector<icu::UnicodeString>&,
+		     std::vector<unsigned int>& );
+    void lookup_batch( const std::vector<icu::UnicodeString>&,
+		       std::vector<unsigned int>& ) const;
+    void reserve( size_t );
     const icu::UnicodeString& reverse_lookup( unsigned int ) const;
+    void save( const std::string& ) const;
+    void load( const std::string& );
   private:
+    static const size_t ARENA_BLOCK = 64 * 1024; //!< UChars per arena block
     unsigned int _num_of_tokens;
-    std::vector<UniInfo*> _rev_index;
-    // Replaced UniTrie with unordered_map
-    std::unordered_map<icu::UnicodeString, UniInfo*, UnicodeStringHash> _map;
+    std::vector<std::unique_ptr<UChar[]>> _arena;
+    UChar *_arena_next;   //!< first free position in the current block
+    size_t _arena_free;   //!< free UChars in the current block
+    /// a slot in the hash table
+    struct slot {
+      unsigned int id;  //!< the ID of the string, 0 for an empty slot
+      uint32_t hash;    //!< the low bits of the hash value of the string
+    };
+    std::deque<icu::UnicodeString> _rev_index; //!< read-only aliases
+    std::vector<slot> _table;
+    UniView store( const UniView& );
+    UniView view( unsigned int ) const;
+    size_t find_slot( const UniView&, size_t ) const;
+    void grow( size_t );
+    unsigned int insert( const UniView&, size_t, size_t );
     UnicodeHash( const UnicodeHash& ) = delete;
     UnicodeHash& operator=( const UnicodeHash& ) = delete;
   };
 
+  /// \brief The UTF8Hash class is used to enumerate UTF-8 encoded strings.
+  ///
+  /// It is the UTF-8 sibling of UnicodeHash: every string gets an UNIQUE id
+  /// assigned (1, 2, 3, ...) and there is a reverse index from the id back
+  /// to the string.
+  ///
+  /// The input is used as is, so there is no conversion to UTF-16 needed.
+  /// The strings are NFC normalized first, and stored as UTF-8 in an arena.
+  /// Invalid UTF-8 is handled like UnicodeFromUTF8() does: the bad bytes
+  /// are replaced by U+FFFD.
+  class UTF8Hash {
+    friend std::ostream& operator << ( std::ostream&, const UTF8Hash& );
+  public:
+    UTF8Hash();
+    ~UTF8Hash();
+    unsigned int num_of_entries() const {
+      /*!
+	\return the number of entries in the UTF8Hash
+      */
+      return _num_of_tokens;
+    };
+    unsigned int hash( const std::string_view& );
+    unsigned int lookup( const std::string_view& ) const;
+    void reserve( size_t );
+    std::string_view reverse_lookup( unsigned int ) const;
+  private:
+    static const size_t ARENA_BLOCK = 128 * 1024; //!< bytes per arena block
+    unsigned int _num_of_tokens;
+    std::vector<std::unique_ptr<char[]>> _arena;
+    char *_arena_next;    //!< first free position in the current block
+    size_t _arena_free;   //!< free bytes in the current block
+    std::vector<std::string_view> _rev_index;
+    std::unordered_map<std::string_view, unsigned int> _map;
+    std::string_view store( const std::string_view& );
+    UTF8Hash( const UTF8Hash& ) = delete;
+    UTF8Hash& operator=( const UTF8Hash& ) = delete;
+  };
+
+  /// \brief A thread-safe variant of UnicodeHash.
+  ///
+  /// It offers the same hash(), lookup() and reverse_lookup() contract and
+  /// also hands out dense IDs 1, 2, 3, ..., but may be used from multiple
+  /// threads without external locking.
+  ///
+  /// The strings are spread over a number of shards, each guarded by its own
+  /// reader/writer lock. lookup() and a hash() of a known string only take a
+  /// shared lock on one shard. A new string takes the exclusive lock on its
+  /// shard only.
+  ///
+  /// The reverse index is a fixed table of segments which double in size and
+  /// are never moved, so reverse_lookup() doesn't lock at all.
+  class ConcurrentUnicodeHash {
+    friend std::ostream& operator << ( std::ostream&,
+				       const ConcurrentUnicodeHash& );
+  public:
+    explicit ConcurrentUnicodeHash( unsigned int = 64 );
+    ~ConcurrentUnicodeHash();
+    unsigned int num_of_entries() const {
+      /*!
+	\return the number of entries in the ConcurrentUnicodeHash
+      */
+      return _num_of_tokens.load( std::memory_order_acquire );
+    };
+    unsigned int hash( const icu::UnicodeString& );
+    unsigned int lookup( const icu::UnicodeString& ) const;
+    const icu::UnicodeString& reverse_lookup( unsigned int ) const;
+  private:
+    /// @cond HIDDEN
+    struct shard {
+      mutable std::shared_mutex lock;
+      std::unordered_map<icu::UnicodeString,
+			 unsigned int,
+			 UnicodeStringHash> map;
+    };
+    /// @endcond
+    static const int SEG_BITS = 10; //!< the first segment holds 2^10 entries
+    static const int NUM_SEGS = 33 - SEG_BITS; //!< enough for 2^32 ID's
+    std::unique_ptr<shard[]> _shards;
+    unsigned int _shard_mask;
+    std::atomic<unsigned int> _num_of_tokens;
+    std::atomic<std::atomic<const icu::UnicodeString*>*> _segments[NUM_SEGS];
+    std::mutex _segment_lock;
+    shard& select_shard( const icu::UnicodeString& ) const;
+    std::atomic<const icu::UnicodeString*>& rev_slot( unsigned int );
+    const std::atomic<const icu::UnicodeString*>& rev_slot( unsigned int ) const;
+    ConcurrentUnicodeHash( const ConcurrentUnicodeHash& ) = delete;
+    ConcurrentUnicodeHash& operator=( const ConcurrentUnicodeHash& ) = delete;
+  };
+
+  /// \brief A read-only UnicodeHash, directly on top of a memory mapped
+  /// snapshot created with UnicodeHash::save()
+  ///
+  /// Nothing is deserialized: lookup() probes the hash table in the file and
+  /// reverse_view() returns a view into the file. All processes using
+  /// the same snapshot share one copy in the page cache.
+  class MappedUnicodeHash {
+    friend std::ostream& operator << ( std::ostream&,
+				       const MappedUnicodeHash& );
+  public:
+    explicit MappedUnicodeHash( const std::string& );
+    ~MappedUnicodeHash();
+    unsigned int num_of_entries() const {
+      /*!
+	\return the number of entries in the MappedUnicodeHash
+      */
+      return _num_of_tokens;
+    };
+    unsigned int lookup( const icu::UnicodeString& ) const;
+    icu::UnicodeString reverse_lookup( unsigned int ) const;
+    UniView reverse_view( unsigned int ) const;
+  private:
+    std::unique_ptr<TiCC::mapped_file> _file;
+    unsigned int _num_of_tokens;
+    const uint64_t *_offsets;
+    const uint32_t *_table;
+    uint64_t _table_mask;
+    const UChar *_data;
+    MappedUnicodeHash( const MappedUnicodeHash& ) = delete;
+    MappedUnicodeHash& operator=( const MappedUnicodeHash& ) = delete;
+  };
+
 }
 #endif
@@ -28,12 +28,26 @@
 #define TICC_UNI_TRIE_H
 
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include "unicode/uchar.h"
 #include "unicode/schriter.h"
 #include "unicode/ustream.h"
+#include "unicode/utf16.h"
+#include "ticcutils/FileUtils.h"
 
 namespace Tries {
   // A node in the generic trie.
   template <class Info> class UniTrieNode;
+  template <class Info> class UniTrie;
   template <class Info> std::ostream& operator<<( std::ostream&,
 						  const UniTrieNode<Info> * );
 
@@ -42,6 +56,7 @@ namespace Tries {
     template <class U>
       friend std::ostream& operator<<( std::ostream&,
 				       const UniTrieNode<U> * );
+    friend class UniTrie<Info>;
   public:
     explicit UniTrieNode( UChar32 );
     ~UniTrieNode();
@@ -49,6 +64,7 @@ namespace Tries {
     Info *scan_tree( const icu::UnicodeString& ) const;
     void Iterate( void(*)( Info *, void * ), void * );
     void Iterate( void(*)( Info * ) );
+    template <class Fun> void walk( Fun, bool );
   private:
     UChar32 label;                //!< the label.
     Info *the_info;               //!< The information at this pnt.
@@ -116,50 +132,88 @@ namespace Tries {
   template <class Info>
     inline std::ostream& operator << ( std::ostream& os,
 				       const UniTrieNode<Info> *tree ){
-    /// recursively print a UniTrie to a stream
-    if ( tree ){
-      os << tree->sub_node;
-      if ( tree->the_info ){
-	os << tree->the_info << std::endl;
+    /// print a UniTrie to a stream
+    /*!
+      For every node, the sub nodes are printed first, then its Info and
+      then its next nodes. Like walk(), this uses an explicit stack, where
+      a node is pushed a second time, marked done, to print its Info after
+      the sub nodes.
+    */
+    std::vector<std::pair<const UniTrieNode<Info>*,bool>> stack;
+    stack.push_back( { tree, false } );
+    while ( !stack.empty() ){
+      auto [node, done] = stack.back();
+      stack.pop_back();
+      if ( !node ){
+	continue;
+      }
+      if ( done ){
+	if ( node->the_info ){
+	  os << node->the_info << std::endl;
+	}
+      }
+      else {
+	stack.push_back( { node->next_node, false } );
+	stack.push_back( { node, true } );
+	stack.push_back( { node->sub_node, false } );
       }
-      os << tree->next_node;
     }
     return os;
   }
 
+  template <class Info>
+  template <class Fun>
+    inline void UniTrieNode<Info>::walk( Fun f, bool siblings ){
+    /// call \e f on each entry in this (sub)tree
+    /*!
+      \param f a callable, which is called with an Info* argument
+      \param siblings when true, also walk the next nodes of this node.
+      Otherwise only this node and its descendants are visited.
+
+      The tree is walked depth first, using an explicit stack instead of
+      recursion, so deep trees can't overflow the call stack.
+    */
+    std::vector<UniTrieNode*> stack;
+    stack.push_back( this );
+    while ( !stack.empty() ){
+      UniTrieNode *node = stack.back();
+      stack.pop_back();
+      if ( node->the_info ){
+	f( node->the_info );
+      }
+      // push the next node first, so the sub node is handled before it
+      if ( node->next_node && ( siblings || node != this ) ){
+	stack.push_back( node->next_node );
+      }
+      if ( node->sub_node ){
+	stack.push_back( node->sub_node );
+      }
+    }
+  }
+
   template <class Info>
     inline void UniTrieNode<Info>::Iterate( void (*F)( Info * ) ){
     /// execute the function F on each entry in the UniTrie
-    if ( the_info ){
+    walk( [&]( Info *info ){
 #pragma omp critical(uni_trie_mod)
-      {
-	F( the_info );
-      }
-    }
-    if ( sub_node ){
-      sub_node->Iterate( F );
-    }
-    if ( next_node ){
-      next_node->Iterate( F );
-    }
+	{
+	  F( info );
+	}
+      },
+      true );
   }
 
   template <class Info>
     inline void UniTrieNode<Info>::Iterate( void (*F)( Info *, void * ),
 					    void *arg ){
     /// execute the function F on each entry in the UniTrie
-    if ( the_info ){
+    walk( [&]( Info *info ){
 #pragma omp critical(uni_trie_mod)
-      {
-	F( the_info, arg );
-      }
-    }
-    if ( sub_node ){
-      sub_node->Iterate( F, arg );
-    }
-    if ( next_node ){
-      next_node->Iterate( F, arg );
-    }
+	{
+	  F( info, arg );
+	}
+      },
+      true );
   }
 
   template <class Info>
@@ -176,8 +230,19 @@ namespace Tries {
     inline UniTrieNode<Info>::~UniTrieNode(){
     /// destroy a UniTrieNode
     delete the_info;
-    delete sub_node;
-    delete next_node;
+    // delete the descendants without recursion
+    std::vector<UniTrieNode*> stack = { sub_node, next_node };
+    while ( !stack.empty() ){
+      UniTrieNode *node = stack.back();
+      stack.pop_back();
+      if ( node ){
+	stack.push_back( node->sub_node );
+	stack.push_back( node->next_node );
+	node->sub_node = NULL;
+	node->next_node = NULL;
+	delete node;
+      }
+    }
   }
 
   template <class Info>
@@ -187,48 +252,41 @@ namespace Tries {
     /*!
       \param info The information to store
       \param uit a Unicode Character iterator
-      If the \e uit iterator is done, we are at the bottom, and we can store the
-      info. If there is already Info, we discard the new \e info
+      We descend the tree, one character of \e uit at a time, adding the
+      missing nodes. When the \e uit iterator is done, we are at the bottom,
+      and we can store the info. If there is already Info, we discard the
+      new \e info
     */
-    if ( uit.current32() == icu::CharacterIterator::DONE ){
-      // we reached the end of 'uit'
-      if ( !the_info ){
-	the_info = info;
-      }
-      else {
-	delete( info );
-      }
-      return the_info;
-    }
-    else {
+    UniTrieNode<Info> *node = this;
+    while ( uit.current32() != icu::CharacterIterator::DONE ){
       // Search all the nodes in the node_list for a
       // fitting sub node. If found, continue with it.
       //
-      UniTrieNode<Info> **subNodePtr = &sub_node; // First one.
-      while (*subNodePtr != NULL) {
-	if ( (*subNodePtr)->label == uit.current32() ) {
-	  // it matches, insert more here
-	  uit.next32(); // move to next character
-	  return (*subNodePtr)->add_to_tree( info, uit );
-	}
-	else if ( (*subNodePtr)->label > uit.current32() ) {
-	  // we have to insert a new UniTrieNode to store info
-	  UniTrieNode<Info> *tmp = *subNodePtr;
-	  *subNodePtr = new UniTrieNode<Info>( uit.current32() );
-	  (*subNodePtr)->next_node = tmp; // and use this als starting point
-	  // for further insertions
-	  uit.next32(); // move to next character
-	  return (*subNodePtr)->add_to_tree( info, uit );
-	}
+      UniTrieNode<Info> **subNodePtr = &node->sub_node; // First one.
+      while ( *subNodePtr != NULL
+	      && (*subNodePtr)->label < uit.current32() ){
 	// we have to move to the next node
 	subNodePtr = &((*subNodePtr)->next_node);
       }
-      // no match, so we create a new one at the end, and continue inserting.
-      //
-      *subNodePtr = new UniTrieNode<Info>( uit.current32() );
-      uit.next32();
-      return (*subNodePtr)->add_to_tree( info, uit );
+      if ( *subNodePtr == NULL
+	   || (*subNodePtr)->label != uit.current32() ){
+	// no match, so we insert a new UniTrieNode here, keeping the
+	// nodes sorted, and continue inserting with it.
+	UniTrieNode<Info> *tmp = *subNodePtr;
+	*subNodePtr = new UniTrieNode<Info>( uit.current32() );
+	(*subNodePtr)->next_node = tmp;
+      }
+      node = *subNodePtr;
+      uit.next32(); // move to next character
+    }
+    // we reached the end of 'uit'
+    if ( !node->the_info ){
+      node->the_info = info;
     }
+    else {
+      delete( info );
+    }
+    return node->the_info;
   }
 
   template <class Info>
@@ -244,11 +302,19 @@ namespace Tries {
   }
 
   // a generic UniTrie.
-  template <class Info> class UniTrie;
   template <class Info> std::ostream &operator<<( std::ostream &,
 						  const UniTrie<Info> * );
 
   /// \brief A class to store opaque data in a UniTrie
+  ///
+  /// While filling, the UniTrie is a tree of linked UniTrieNode's. When
+  /// all data is stored, freeze() may be called to compact the UniTrie into
+  /// a few flat arrays, which is much faster to search. A frozen UniTrie
+  /// can't be changed anymore.
+  ///
+  /// ForEachDo() calls a function on every entry, one at a time.
+  /// ParallelForEachDo() spreads the entries over OpenMP threads, and only
+  /// serializes the calls when the function isn't declared thread safe.
   template <class Info> class UniTrie {
     template <class U>
     friend std::ostream &operator << ( std::ostream &,
@@ -260,36 +326,746 @@ namespace Tries {
       };
     ~UniTrie() {
       delete Tree;
+      for ( const auto& node : _nodes ){
+	delete node.info;
+      }
     };
     Info *Store( const icu::UnicodeString& str, Info *info ) {
+      if ( !Tree ){
+	delete info; // like a double entry
+	throw std::logic_error( "UniTrie::Store() on a frozen UniTrie" );
+      }
       return Tree->add_to_tree( info, str );
     };
-    Info *Retrieve( const icu::UnicodeString& str ) const{
-      return Tree->scan_tree( str ); };
+    Info *Retrieve( const icu::UnicodeString& str ) const {
+      if ( Tree ){
+	return Tree->scan_tree( str );
+      }
+      return frozen_retrieve( str );
+    };
     void ForEachDo( void F( Info *, void * ), void *arg ){
       if ( Tree ) {
 	Tree->Iterate( F, arg );
       }
+      else {
+	frozen_walk( [&]( Info *info ){
+#pragma omp critical(uni_trie_mod)
+	    {
+	      F( info, arg );
+	    }
+	  } );
+      }
     };
     void ForEachDo( void F( Info * ) ) {
       if ( Tree ){
 	Tree->Iterate( F );
       }
+      else {
+	frozen_walk( [&]( Info *info ){
+#pragma omp critical(uni_trie_mod)
+	    {
+	      F( info );
+	    }
+	  } );
+      }
+    };
+    void ParallelForEachDo( void F( Info *, void * ), void *arg,
+			    bool thread_safe = false ){
+      if ( thread_safe ){
+	parallel_walk( [&]( Info *info ){
+	    F( info, arg );
+	  } );
+      }
+      else {
+	parallel_walk( [&]( Info *info ){
+#pragma omp critical(uni_trie_mod)
+	    {
+	      F( info, arg );
+	    }
+	  } );
+      }
+    };
+    void ParallelForEachDo( void F( Info * ), bool thread_safe = false ){
+      if ( thread_safe ){
+	parallel_walk( [&]( Info *info ){
+	    F( info );
+	  } );
+      }
+      else {
+	parallel_walk( [&]( Info *info ){
+#pragma omp critical(uni_trie_mod)
+	    {
+	      F( info );
+	    }
+	  } );
+      }
+    };
+    Info *longest_prefix( const icu::UnicodeString&, int32_t, int32_t& ) const;
+    void all_prefixes( const icu::UnicodeString&, int32_t,
+		       void F( Info *, int32_t, void * ), void * ) const;
+    void find_all( const icu::UnicodeString&,
+		   void F( Info *, int32_t, int32_t, void * ), void * ) const;
+    void freeze();
+    template <class Codec> void save( const std::string& ) const;
+    bool frozen() const {
+      /*!
+	\return true when freeze() is called
+      */
+      return Tree == NULL;
     };
   protected:
     UniTrieNode<Info> *Tree;
+    /// @cond HIDDEN
+    struct frozen_node {
+      uint32_t first_child;  // index of the first child in _nodes
+      uint32_t num_children; // the children are stored consecutively
+      Info *info;
+    };
+    /// @endcond
+    std::vector<frozen_node> _nodes;  //!< the frozen nodes. 0 is the root
+    std::vector<UChar32> _labels;     //!< the label of every frozen node
+    std::vector<uint32_t> _fail;      //!< Aho-Corasick failure links
+    std::vector<uint32_t> _dict;      //!< next node with Info on the _fail
+				      //!< chain. 0 if none
+    std::vector<int32_t> _depth;      //!< length in UTF-16 units per node
+    uint32_t frozen_child( uint32_t, UChar32 ) const;
+    Info *frozen_retrieve( const icu::UnicodeString& ) const;
+    template <class Fun>
+      void prefix_walk( const icu::UnicodeString&, int32_t, Fun ) const;
+    template <class Fun> void frozen_walk( Fun ) const;
+    template <class Fun> void parallel_walk( Fun );
+    void frozen_print( std::ostream&, uint32_t ) const;
     UniTrie( const UniTrie& );
     UniTrie& operator=( const UniTrie& );
   };
 
+  template <class Info>
+    inline void UniTrie<Info>::freeze(){
+    /// compact the UniTrie into flat arrays
+    /*!
+      The nodes are stored breadth first, so the children of every node are
+      consecutive, sorted on their label. Searching a child is a binary
+      search in a small array, instead of following a linked list.
+
+      After freezing, Store() will throw. Calling freeze() again is a no-op.
+    */
+    if ( !Tree ){
+      return;
+    }
+    std::vector<UniTrieNode<Info>*> todo; // parallel to _nodes
+    todo.push_back( Tree );
+    _nodes.push_back( { 0, 0, Tree->the_info } );
+    _labels.push_back( Tree->label );
+    for ( size_t i=0; i < todo.size(); ++i ){
+      uint32_t first = static_cast<uint32_t>( _nodes.size() );
+      uint32_t count = 0;
+      for ( UniTrieNode<Info> *child = todo[i]->sub_node;
+	    child;
+	    child = child->next_node ){
+	todo.push_back( child );
+	_nodes.push_back( { 0, 0, child->the_info } );
+	_labels.push_back( child->label );
+	++count;
+      }
+      _nodes[i].first_child = first;
+      _nodes[i].num_children = count;
+    }
+    // the Info is ours now
+    for ( auto& node : todo ){
+      node->the_info = NULL;
+    }
+    _nodes.shrink_to_fit();
+    _labels.shrink_to_fit();
+    delete Tree;
+    Tree = NULL;
+    // now add the Aho-Corasick links. The nodes are in breadth first order,
+    // so all shallower nodes are done when we get to a node.
+    _fail.assign( _nodes.size(), 0 );
+    _dict.assign( _nodes.size(), 0 );
+    _depth.assign( _nodes.size(), 0 );
+    for ( uint32_t parent=0; parent < _nodes.size(); ++parent ){
+      const frozen_node& pn = _nodes[parent];
+      for ( uint32_t child = pn.first_child;
+	    child < pn.first_child + pn.num_children;
+	    ++child ){
+	const UChar32 c = _labels[child];
+	_depth[child] = _depth[parent] + U16_LENGTH( c );
+	uint32_t fail = 0;
+	if ( parent != 0 ){
+	  // the longest proper suffix which is also in the trie
+	  uint32_t f = _fail[parent];
+	  while ( true ){
+	    uint32_t next = frozen_child( f, c );
+	    if ( next != 0 ){
+	      fail = next;
+	      break;
+	    }
+	    if ( f == 0 ){
+	      break;
+	    }
+	    f = _fail[f];
+	  }
+	}
+	_fail[child] = fail;
+	_dict[child] = _nodes[fail].info ? fail : _dict[fail];
+      }
+    }
+  }
+
+  template <class Info>
+    inline uint32_t UniTrie<Info>::frozen_child( uint32_t node,
+						 UChar32 c ) const {
+    /// find the child of \e node with label \e c in a frozen UniTrie
+    /*!
+      \return the index of the child, or 0 when there is none. (the root is
+      nobody's child)
+    */
+    const frozen_node& n = _nodes[node];
+    auto first = _labels.begin() + n.first_child;
+    auto last = first + n.num_children;
+    auto it = std::lower_bound( first, last, c );
+    if ( it == last || *it != c ){
+      return 0;
+    }
+    return static_cast<uint32_t>( it - _labels.begin() );
+  }
+
+  template <class Info>
+    inline Info *UniTrie<Info>::frozen_retrieve( const icu::UnicodeString& str ) const {
+    /// search \e str in a frozen UniTrie
+    /*!
+      \param str the string to search
+      \return the Info stored for \e str, or NULL
+    */
+    const UChar *buf = str.getBuffer();
+    const int32_t len = str.length();
+    if ( len == 0 ){
+      // like scan_tree(), the empty string is never found
+      return NULL;
+    }
+    uint32_t node = 0;
+    int32_t pos = 0;
+    while ( pos < len ){
+      UChar32 c;
+      U16_NEXT( buf, pos, len, c );
+      node = frozen_child( node, c );
+      if ( node == 0 ){
+	return NULL;
+      }
+    }
+    return _nodes[node].info;
+  }
+
+  template <class Info>
+  template <class Fun>
+    inline void UniTrie<Info>::prefix_walk( const icu::UnicodeString& text,
+					    int32_t pos,
+					    Fun f ) const {
+    /// walk the UniTrie along \e text, starting at \e pos, and call \e f
+    /// for every stored entry which matches a prefix
+    /*!
+      \param text the string to walk along
+      \param pos the start position (in UTF-16 units)
+      \param f called as f( info, length ), shortest prefixes first. When it
+      returns false, the walk stops.
+    */
+    const UChar *buf = text.getBuffer();
+    const int32_t len = text.length();
+    if ( pos < 0 || pos >= len ){
+      return;
+    }
+    int32_t i = pos;
+    if ( Tree ){
+      const UniTrieNode<Info> *node = Tree;
+      while ( i < len ){
+	UChar32 c;
+	U16_NEXT( buf, i, len, c );
+	const UniTrieNode<Info> *sub = node->sub_node;
+	while ( sub && sub->label < c ){
+	  sub = sub->next_node;
+	}
+	if ( !sub || sub->label != c ){
+	  return;
+	}
+	node = sub;
+	if ( node->the_info && !f( node->the_info, i - pos ) ){
+	  return;
+	}
+      }
+    }
+    else {
+      uint32_t node = 0;
+      while ( i < len ){
+	UChar32 c;
+	U16_NEXT( buf, i, len, c );
+	node = frozen_child( node, c );
+	if ( node == 0 ){
+	  return;
+	}
+	if ( _nodes[node].info && !f( _nodes[node].info, i - pos ) ){
+	  return;
+	}
+      }
+    }
+  }
+
+  template <class Info>
+    inline Info *UniTrie<Info>::longest_prefix( const icu::UnicodeString& text,
+						int32_t pos,
+						int32_t& length ) const {
+    /// find the longest entry in the UniTrie which is a prefix of \e text
+    /// from position \e pos on
+    /*!
+      \param text the string to search in
+      \param pos the position in \e text (in UTF-16 units) to start
+      \param length will be set to the length (in UTF-16 units) of the match,
+      or 0 when not found
+      \return the Info of the longest match, or NULL when not found
+    */
+    Info *result = NULL;
+    length = 0;
+    prefix_walk( text, pos,
+		 [&]( Info *info, int32_t len ){
+		   result = info;
+		   length = len;
+		   return true;
+		 } );
+    return result;
+  }
+
+  template <class Info>
+    inline void UniTrie<Info>::all_prefixes( const icu::UnicodeString& text,
+					     int32_t pos,
+					     void F( Info *, int32_t, void * ),
+					     void *arg ) const {
+    /// find all entries in the UniTrie which are a prefix of \e text from
+    /// position \e pos on
+    /*!
+      \param text the string to search in
+      \param pos the position in \e text (in UTF-16 units) to start
+      \param F is called for every match, shortest first, with the Info,
+      the length of the match (in UTF-16 units) and \e arg
+      \param arg an extra argument passed to F
+
+      The trie is walked only once, so this is linear in the length of the
+      longest match.
+    */
+    prefix_walk( text, pos,
+		 [&]( Info *info, int32_t len ){
+		   F( info, len, arg );
+		   return true;
+		 } );
+  }
+
+  template <class Info>
+    inline void UniTrie<Info>::find_all( const icu::UnicodeString& text,
+					 void F( Info *, int32_t, int32_t,
+						 void * ),
+					 void *arg ) const {
+    /// find all occurrences of all entries of a frozen UniTrie in \e text
+    /*!
+      \param text the string to search in
+      \param F is called for every match, with the Info, the start and the
+      length of the match (both in UTF-16 units) and \e arg. The matches are
+      reported in the order of their end position, and for the same end
+      position the longest first.
+      \param arg an extra argument passed to F
+
+      This uses the Aho-Corasick automaton built by freeze(), so it takes
+      one pass over \e text. Will throw when the UniTrie isn't frozen.
+    */
+    if ( Tree ){
+      throw std::logic_error( "UniTrie::find_all() needs a frozen UniTrie" );
+    }
+    const UChar *buf = text.getBuffer();
+    const int32_t len = text.length();
+    uint32_t state = 0;
+    int32_t i = 0;
+    while ( i < len ){
+      UChar32 c;
+      U16_NEXT( buf, i, len, c );
+      uint32_t next = frozen_child( state, c );
+      while ( next == 0 && state != 0 ){
+	state = _fail[state];
+	next = frozen_child( state, c );
+      }
+      state = next;
+      uint32_t hit = _nodes[state].info ? state : _dict[state];
+      while ( hit != 0 ){
+	F( _nodes[hit].info, i - _depth[hit], _depth[hit], arg );
+	hit = _dict[hit];
+      }
+    }
+  }
+
+  template <class Info>
+  template <class Fun>
+    inline void UniTrie<Info>::frozen_walk( Fun f ) const {
+    /// call \e f for every Info in a frozen UniTrie, in the same order as
+    /// UniTrieNode::Iterate() does
+    std::vector<uint32_t> stack;
+    stack.push_back( 0 );
+    while ( !stack.empty() ){
+      const frozen_node& n = _nodes[stack.back()];
+      stack.pop_back();
+      if ( n.info ){
+	f( n.info );
+      }
+      for ( uint32_t c = n.num_children; c > 0; --c ){
+	// push in reverse, so the lowest label comes first
+	stack.push_back( n.first_child + c - 1 );
+      }
+    }
+  }
+
+  template <class Info>
+  template <class Fun>
+    inline void UniTrie<Info>::parallel_walk( Fun f ){
+    /// call \e f for every Info in the UniTrie, using multiple threads
+    /*!
+      \param f a callable, which is called with an Info* argument. It is
+      called concurrently, in no particular order.
+
+      On a linked UniTrie, every subtree below the root becomes an OpenMP
+      task. On a frozen UniTrie the nodes are simply divided over the
+      threads.
+    */
+    if ( Tree ){
+      if ( Tree->the_info ){
+	f( Tree->the_info );
+      }
+#pragma omp parallel
+#pragma omp single
+      {
+	for ( UniTrieNode<Info> *sub = Tree->sub_node;
+	      sub;
+	      sub = sub->next_node ){
+#pragma omp task firstprivate(sub)
+	  sub->walk( f, false );
+	}
+      }
+    }
+    else {
+      const long int size = static_cast<long int>( _nodes.size() );
+#pragma omp parallel for schedule(dynamic,1024)
+      for ( long int i=0; i < size; ++i ){
+	if ( _nodes[i].info ){
+	  f( _nodes[i].info );
+	}
+      }
+    }
+  }
+
+  template <class Info>
+    inline void UniTrie<Info>::frozen_print( std::ostream& os,
+					     uint32_t node ) const {
+    /// print a frozen (sub)tree to a stream
+    /*!
+      The children are printed before the Info of their parent, using an
+      explicit stack like UniTrieNode::walk()
+    */
+    std::vector<std::pair<uint32_t,bool>> stack;
+    stack.push_back( { node, false } );
+    while ( !stack.empty() ){
+      auto [i, done] = stack.back();
+      stack.pop_back();
+      const frozen_node& n = _nodes[i];
+      if ( done ){
+	if ( n.info ){
+	  os << n.info << std::endl;
+	}
+      }
+      else {
+	stack.push_back( { i, true } );
+	// push the children in reverse, so the first is printed first
+	for ( uint32_t c = n.num_children; c > 0; --c ){
+	  stack.push_back( { n.first_child + c - 1, false } );
+	}
+      }
+    }
+  }
+
   template <class Info>
     inline std::ostream &operator << ( std::ostream &os,
 				       const UniTrie<Info> *T ){
     if ( T ){
-      os << T->Tree;
+      if ( T->Tree ){
+	os << T->Tree;
+      }
+      else {
+	T->frozen_print( os, 0 );
+      }
     }
     return os;
   }
 
+  /// @cond HIDDEN
+  //
+  // The snapshot format of a frozen UniTrie. All numbers are in native
+  // byte order.
+  //
+  //   trie_snapshot_header
+  //   trie_snapshot_node nodes[num_nodes]  in the frozen order, 0 is the root
+  //   int32_t labels[num_nodes]            the label of every node
+  //   (padding to a multiple of 8)
+  //   char data[data_length]               all encoded Info
+  //
+  struct trie_snapshot_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint64_t num_nodes;
+    uint64_t num_entries;
+    uint64_t data_length;
+  };
+
+  struct trie_snapshot_node {
+    uint32_t first_child;
+    uint32_t num_children;
+    uint64_t info_start;   // no_info when there is no Info
+    uint64_t info_size;
+  };
+
+  static const char trie_snapshot_magic[8] = { 'T','i','C','C','U','T','\0','\1' };
+  static const uint32_t trie_snapshot_byte_order = 0x01020304;
+  static const uint32_t trie_snapshot_version = 1;
+  static const uint64_t trie_snapshot_no_info = UINT64_MAX;
+  /// @endcond
+
+  template <class Info>
+  template <class Codec>
+    inline void UniTrie<Info>::save( const std::string& filename ) const {
+    /// save a frozen UniTrie in a binary snapshot file
+    /*!
+      \param filename the file to create
+      \tparam Codec a class with a static function
+      std::string encode( const Info& ), which turns an Info into bytes.
+      The matching Info decode( std::string_view ) is used by
+      MappedUniTrie.
+
+      Will throw when the UniTrie isn't frozen, or on failure.
+    */
+    if ( Tree ){
+      throw std::logic_error( "UniTrie::save() needs a frozen UniTrie" );
+    }
+    trie_snapshot_header head;
+    memcpy( head.magic, trie_snapshot_magic, sizeof(head.magic) );
+    head.byte_order = trie_snapshot_byte_order;
+    head.version = trie_snapshot_version;
+    head.num_nodes = _nodes.size();
+    head.num_entries = 0;
+    std::vector<trie_snapshot_node> nodes( _nodes.size() );
+    std::string data;
+    for ( size_t i=0; i < _nodes.size(); ++i ){
+      nodes[i].first_child = _nodes[i].first_child;
+      nodes[i].num_children = _nodes[i].num_children;
+      if ( _nodes[i].info ){
+	std::string bytes = Codec::encode( *_nodes[i].info );
+	nodes[i].info_start = data.size();
+	nodes[i].info_size = bytes.size();
+	data += bytes;
+	++head.num_entries;
+      }
+      else {
+	nodes[i].info_start = trie_snapshot_no_info;
+	nodes[i].info_size = 0;
+      }
+    }
+    head.data_length = data.size();
+    std::ofstream os( filename, std::ios::binary );
+    if ( !os ){
+      throw std::runtime_error( "UniTrie::save(): unable to open '"
+				+ filename + "'" );
+    }
+    os.write( reinterpret_cast<const char*>(&head), sizeof(head) );
+    os.write( reinterpret_cast<const char*>(nodes.data()),
+	      nodes.size() * sizeof(trie_snapshot_node) );
+    static_assert( sizeof(UChar32) == sizeof(int32_t),
+		   "labels are stored as 32 bits" );
+    const size_t label_bytes = _labels.size() * sizeof(int32_t);
+    os.write( reinterpret_cast<const char*>(_labels.data()), label_bytes );
+    const char zeros[8] = {0};
+    os.write( zeros, (8 - label_bytes % 8) % 8 );
+    os.write( data.data(), data.size() );
+    if ( !os ){
+      throw std::runtime_error( "UniTrie::save(): writing '"
+				+ filename + "' failed" );
+    }
+  }
+
+  /// \brief A read-only UniTrie, directly on top of a memory mapped
+  /// snapshot created with UniTrie::save()
+  ///
+  /// Nothing is deserialized when opening, so that is fast whatever the
+  /// size of the dictionary, and all processes using the same snapshot
+  /// share one copy in the page cache. Only the Info found by Retrieve() is
+  /// decoded, using a Codec with a static function
+  /// Info decode( std::string_view ).
+  template <class Info, class Codec> class MappedUniTrie {
+  public:
+    explicit MappedUniTrie( const std::string& );
+    size_t num_of_entries() const {
+      /*!
+	\return the number of entries in the MappedUniTrie
+      */
+      return _num_of_entries;
+    };
+    bool Retrieve( const icu::UnicodeString&, Info& ) const;
+    bool RetrieveRaw( const icu::UnicodeString&, std::string_view& ) const;
+  private:
+    std::unique_ptr<TiCC::mapped_file> _file;
+    size_t _num_of_entries;
+    const trie_snapshot_node *_nodes;
+    const int32_t *_labels;
+    const char *_data;
+    MappedUniTrie( const MappedUniTrie& ) = delete;
+    MappedUniTrie& operator=( const MappedUniTrie& ) = delete;
+  };
+
+  template <class Info, class Codec>
+    inline MappedUniTrie<Info,Codec>::MappedUniTrie( const std::string& filename ):
+    _file( new TiCC::mapped_file( filename ) )
+    {
+      /// map a snapshot created by UniTrie::save() into memory
+      /*!
+	\param filename the snapshot file.
+	Will throw when the file is not a valid snapshot. The whole file is
+	checked here, so Retrieve() can trust it.
+      */
+      const char *base = _file->data();
+      const size_t size = _file->size();
+      trie_snapshot_header head;
+      if ( size < sizeof(head) ){
+	throw std::runtime_error( "MappedUniTrie: '" + filename
+				  + "' is not a UniTrie snapshot" );
+      }
+      memcpy( &head, base, sizeof(head) );
+      if ( memcmp( head.magic, trie_snapshot_magic, sizeof(head.magic) ) != 0 ){
+	throw std::runtime_error( "MappedUniTrie: '" + filename
+				  + "' is not a UniTrie snapshot" );
+      }
+      if ( head.byte_order != trie_snapshot_byte_order ){
+	throw std::runtime_error( "MappedUniTrie: '" + filename
+				  + "' was created on a machine with another"
+				  " byte order" );
+      }
+      if ( head.version != trie_snapshot_version ){
+	throw std::runtime_error( "MappedUniTrie: '" + filename
+				  + "' has an unsupported version: "
+				  + std::to_string( head.version ) );
+      }
+      // check the sizes, without overflowing on a corrupt header
+      size_t rest = size - sizeof(head);
+      bool ok = head.num_nodes > 0
+	&& head.num_nodes <= UINT32_MAX
+	&& head.num_entries <= head.num_nodes
+	&& head.num_nodes <= rest / sizeof(trie_snapshot_node);
+      size_t node_bytes = 0;
+      size_t label_bytes = 0;
+      size_t pad = 0;
+      if ( ok ){
+	node_bytes = head.num_nodes * sizeof(trie_snapshot_node);
+	rest -= node_bytes;
+	ok = head.num_nodes <= rest / sizeof(int32_t);
+      }
+      if ( ok ){
+	label_bytes = head.num_nodes * sizeof(int32_t);
+	rest -= label_bytes;
+	pad = (8 - label_bytes % 8) % 8;
+	ok = pad <= rest && head.data_length == rest - pad;
+      }
+      const trie_snapshot_node *nodes
+	= reinterpret_cast<const trie_snapshot_node*>( base + sizeof(head) );
+      const int32_t *labels
+	= reinterpret_cast<const int32_t*>( base + sizeof(head) + node_bytes );
+      if ( ok ){
+	// the children of a node must exist, come after it and be sorted on
+	// a valid code point, which RetrieveRaw() relies on. And every Info
+	// must lie within the data.
+	uint64_t entries = 0;
+	for ( uint64_t i=0; ok && i < head.num_nodes; ++i ){
+	  const trie_snapshot_node& n = nodes[i];
+	  if ( n.num_children > 0 ){
+	    ok = n.first_child > i
+	      && n.num_children <= head.num_nodes - n.first_child;
+	    for ( uint64_t c=n.first_child;
+		  ok && c < uint64_t(n.first_child) + n.num_children;
+		  ++c ){
+	      ok = labels[c] >= 0 && labels[c] <= UCHAR_MAX_VALUE
+		&& ( c == n.first_child || labels[c-1] < labels[c] );
+	    }
+	  }
+	  if ( ok && n.info_start != trie_snapshot_no_info ){
+	    ok = n.info_start <= head.data_length
+	      && n.info_size <= head.data_length - n.info_start;
+	    ++entries;
+	  }
+	}
+	ok = ok && entries == head.num_entries;
+      }
+      if ( !ok ){
+	throw std::runtime_error( "MappedUniTrie: '" + filename
+				  + "' is corrupt" );
+      }
+      _num_of_entries = head.num_entries;
+      _nodes = nodes;
+      _labels = labels;
+      _data = base + sizeof(head) + node_bytes + label_bytes + pad;
+    }
+
+  template <class Info, class Codec>
+    inline bool MappedUniTrie<Info,Codec>::RetrieveRaw( const icu::UnicodeString& str,
+							std::string_view& raw ) const {
+    /// search \e str in the MappedUniTrie, without decoding the Info
+    /*!
+      \param str the string to search
+      \param raw set to the encoded Info, as a view into the mapped file
+      \return true when found
+    */
+    const UChar *buf = str.getBuffer();
+    const int32_t len = str.length();
+    if ( len == 0 ){
+      // like UniTrie::Retrieve(), the empty string is never found
+      return false;
+    }
+    uint32_t node = 0;
+    int32_t pos = 0;
+    while ( pos < len ){
+      UChar32 c;
+      U16_NEXT( buf, pos, len, c );
+      const trie_snapshot_node& n = _nodes[node];
+      const int32_t *first = _labels + n.first_child;
+      const int32_t *last = first + n.num_children;
+      const int32_t *it = std::lower_bound( first, last, c );
+      if ( it == last || *it != c ){
+	return false;
+      }
+      node = static_cast<uint32_t>( it - _labels );
+    }
+    const trie_snapshot_node& n = _nodes[node];
+    if ( n.info_start == trie_snapshot_no_info ){
+      return false;
+    }
+    raw = std::string_view( _data + n.info_start, n.info_size );
+    return true;
+  }
+
+  template <class Info, class Codec>
+    inline bool MappedUniTrie<Info,Codec>::Retrieve( const icu::UnicodeString& str,
+						     Info& info ) const {
+    /// search \e str in the MappedUniTrie
+    /*!
+      \param str the string to search
+      \param info set to the decoded Info, when found
+      \return true when found
+    */
+    std::string_view raw;
+    if ( RetrieveRaw( str, raw ) ){
+      info = Codec::decode( raw );
+      return true;
+    }
+    return false;
+  }
+
 }
 #endif
@@ -29,8 +29,15 @@
 */
 
 #include <cstddef>
+#include <algorithm>
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
 #include <sstream>
 #include <typeinfo>
 #include <stdexcept>
@@ -41,6 +48,8 @@
 #include "unicode/ustream.h"
 #include "unicode/normalizer2.h"
 #include "unicode/regex.h"
+#include "unicode/ucnv.h"
+#include "ticcutils/StringOps.h"
 
 namespace TiCC {
   using namespace icu;
@@ -55,6 +64,9 @@ namespace TiCC {
   UnicodeString UnicodeFromUTF8( const std::string&,
 				 const std::string& = "" );
 
+  /// a [start,end) range of UTF-16 offsets in a UnicodeString
+  typedef std::pair<int32_t,int32_t> UnicodeSpan;
+
   /// \brief a class that can normalize UnicodeStrings to NFC/NFD/NFKC/NFKD
   class UnicodeNormalizer {
   public:
@@ -63,6 +75,10 @@ namespace TiCC {
       UnicodeNormalizer( std::string(str) ){};
     ~UnicodeNormalizer();
     UnicodeString normalize( const UnicodeString& );
+    void normalize_inplace( UnicodeString& );
+    void normalize( const std::string&, std::string& );
+    void normalize( std::istream&, std::ostream& );
+    void normalize_parallel( std::istream&, std::ostream& );
     const std::string setMode( const std::string& );
     const std::string& getMode() const { return _mode; };
   private:
@@ -70,24 +86,62 @@ namespace TiCC {
     std::string _mode;
   };
 
+  /// \brief a class to read normalized UnicodeString lines from an
+  /// encoded stream
+  class UnicodeLineReader {
+  public:
+    explicit UnicodeLineReader( std::istream&,
+				const std::string& = "UTF8",
+				const std::string& = "NFC",
+				const char = '\n' );
+    ~UnicodeLineReader();
+    bool getline( UnicodeString& );
+    bool eof() const { return _eof; };
+  private:
+    // inhibit copies!
+    UnicodeLineReader( const UnicodeLineReader& ) = delete;
+    UnicodeLineReader& operator=( const UnicodeLineReader& ) = delete;
+    bool fill_buffer();
+    void convert( const char *, size_t, UnicodeString& );
+    std::istream& _is;
+    UConverter *_converter;
+    UnicodeNormalizer _normalizer;
+    char _delim;
+    std::vector<char> _buffer;
+    size_t _pos;
+    size_t _end;
+    std::string _line;
+    bool _eof;
+  };
+
   /// \brief a class that can match UnicodeStrings to Regex patterns
   class UnicodeRegexMatcher {
   public:
+    typedef UnicodeSpan span;
     explicit UnicodeRegexMatcher( const UnicodeString&,
 				  const UnicodeString& name="" );
     ~UnicodeRegexMatcher();
     bool match_all( const UnicodeString&, UnicodeString&, UnicodeString&  );
+    bool match_offsets( const UnicodeString&,
+			std::vector<span>&,
+			span&,
+			span& ) const;
     const UnicodeString get_match( unsigned int ) const;
     int NumOfMatches() const;
     int split( const UnicodeString&, std::vector<UnicodeString>& );
+    int split( const UnicodeString&, std::vector<span>& ) const;
     UnicodeString Pattern() const;
     bool set_debug( bool b ){ bool r = _debug; _debug = b; return r; };
   private:
      // inhibit copies!
     UnicodeRegexMatcher( const UnicodeRegexMatcher& ) = delete;
     UnicodeRegexMatcher& operator=( const UnicodeRegexMatcher& ) = delete;
+    class matcher_lease;
     RegexPattern *_pattern;
-    RegexMatcher *_matcher;
+    // RegexMatchers are not thread safe. Keep a pool of them, all
+    // created from _pattern
+    mutable std::mutex _pool_lock;
+    mutable std::vector<RegexMatcher*> _pool;
     UnicodeRegexMatcher();
     std::vector<UnicodeString> _results;
     const UnicodeString _name;
@@ -101,17 +155,52 @@ namespace TiCC {
     UniFilter();
     ~UniFilter();
     bool init( const UnicodeString&, const UnicodeString& );
-    bool is_initialized() const { return _trans != 0; };
+    bool is_initialized() const { return _trans != 0 || !_pending.empty(); };
     bool fill( const std::string&, const std::string& = "" );
     bool add( const std::string& );
     bool add( const UnicodeString& );
     UnicodeString filter( const UnicodeString& );
+    void filter_batch( std::vector<UnicodeString>& );
     UnicodeString get_rules() const;
   private:
-    Transliterator *_trans;
+    // inhibit copies!
+    UniFilter( const UniFilter& ) = delete;
+    UniFilter& operator=( const UniFilter& ) = delete;
+    void compile() const;
+    Transliterator *thread_transliterator();
+    mutable Transliterator *_trans;
+    mutable std::vector<UnicodeString> _pending;
+    mutable std::string _error;
+    mutable std::shared_mutex _lock;
+    // Transliterators are not thread safe. Every thread keeps its own
+    // clone, which refers weakly to this token. A new token is made on
+    // every change of the rules, so the clones know they are outdated
+    mutable std::shared_ptr<char> _token;
   };
 
   UnicodeString filter_diacritics( const UnicodeString& );
+  void filter_diacritics_batch( std::vector<UnicodeString>& );
+
+  /// \brief a set of Unicode characters, with a fast membership test
+  class UnicodeCharSet {
+  public:
+    explicit UnicodeCharSet( const UnicodeString& );
+    bool contains( UChar32 c ) const {
+      if ( c < 0x10000 ){
+	size_t word = c >> 6;
+	return word < _bmp.size() && ( ( _bmp[word] >> ( c & 63 ) ) & 1 );
+      }
+      return std::binary_search( _supplementary.begin(),
+				 _supplementary.end(),
+				 c );
+    };
+    bool empty() const { return _bmp.empty() && _supplementary.empty(); };
+    int32_t find_first( const UnicodeString&, int32_t, int32_t& ) const;
+  private:
+    // a bitmap for the BMP, only as large as the highest character needs
+    std::vector<uint64_t> _bmp;
+    std::vector<UChar32> _supplementary;
+  };
 
   std::vector<UnicodeString> split_at( const UnicodeString&,
 				       const UnicodeString&,
@@ -132,6 +221,25 @@ namespace TiCC {
     return split_exact_at_first_of( s, " \r\t\n" );
   }
 
+  // the same, but giving the offsets of the parts, instead of copies
+  size_t split_at( const UnicodeString&,
+		   const UnicodeString&,
+		   std::vector<UnicodeSpan>&,
+		   size_t = 0 );
+  size_t split_at_first_of( const UnicodeString&,
+			    const UnicodeCharSet&,
+			    std::vector<UnicodeSpan>&,
+			    size_t = 0 );
+  size_t split( const UnicodeString&,
+		std::vector<UnicodeSpan>&,
+		size_t = 0 );
+  size_t split_exact_at( const UnicodeString&,
+			 const UnicodeString&,
+			 std::vector<UnicodeSpan>& );
+  size_t split_exact_at_first_of( const UnicodeString&,
+				  const UnicodeCharSet&,
+				  std::vector<UnicodeSpan>& );
+
   UnicodeString utrim( const UnicodeString&, const UnicodeString& = "\r\n\t " );
   UnicodeString ltrim( const UnicodeString&, const UnicodeString& = "\r\n\t " );
   UnicodeString rtrim( const UnicodeString&, const UnicodeString& = "\r\n\t " );
@@ -173,6 +281,14 @@ namespace TiCC {
 
   template< typename T >
     inline icu::UnicodeString toUnicodeString ( const T& obj ) {
+    if constexpr ( from_chars_type_v<T> ){
+      char buf[64];
+      size_t len = fast_toString( obj, buf, sizeof(buf) );
+      if ( len > 0 ){
+	// plain ASCII, so nothing to normalize
+	return icu::UnicodeString( buf, static_cast<int32_t>(len), US_INV );
+      }
+    }
     std::stringstream dummy;
     if ( !( dummy << obj ) ) {
       throw( std::runtime_error( std::string("conversion from type:")
@@ -192,6 +308,27 @@ namespace TiCC {
   inline icu::UnicodeString join( const std::vector<T>& vec,
 				  const icu::UnicodeString& sep = " " ){
     icu::UnicodeString result;
+    if constexpr ( from_chars_type_v<T> ){
+      // format numbers in place, avoiding a temporary UnicodeString
+      // for every element
+      char buf[64];
+      UChar ubuf[64];
+      for ( const auto& it : vec ){
+	if ( &it != &(*vec.begin() ) ){
+	  result += sep;
+	}
+	size_t len = fast_toString( it, buf, sizeof(buf) );
+	if ( len == 0 ){
+	  result += TiCC::toUnicodeString(it);
+	  continue;
+	}
+	for ( size_t i=0; i < len; ++i ){
+	  ubuf[i] = static_cast<UChar>( buf[i] );
+	}
+	result.append( ubuf, 0, static_cast<int32_t>(len) );
+      }
+      return result;
+    }
     for ( const auto& it : vec ){
       if ( &it != &(*vec.begin() ) ){
 	result += sep;
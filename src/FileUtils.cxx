@@ -37,6 +37,9 @@
 #include <fstream>
 #include <filesystem>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <regex>
 #include "ticcutils/StringOps.h"
 
@@ -361,4 +364,44 @@ namespace TiCC {
     }
   }
 
+  mapped_file::mapped_file( const string& name ):
+    _name( name ),
+    _data( 0 ),
+    _size( 0 )
+  {
+    /// map a file read-only into memory
+    /*!
+      \param name the file to map
+      Will throw when the file can't be opened or mapped.
+      The pages are shared with all other processes mapping the same file.
+    */
+    int fd = open( name.c_str(), O_RDONLY );
+    if ( fd < 0 ){
+      throw runtime_error( "mapped_file: unable to open '" + name + "'" );
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 ){
+      close( fd );
+      throw runtime_error( "mapped_file: unable to stat '" + name + "'" );
+    }
+    _size = st.st_size;
+    if ( _size > 0 ){
+      void *addr = mmap( 0, _size, PROT_READ, MAP_SHARED, fd, 0 );
+      if ( addr == MAP_FAILED ){
+	close( fd );
+	throw runtime_error( "mapped_file: unable to map '" + name + "'" );
+      }
+      _data = static_cast<const char*>(addr);
+    }
+    // the mapping stays valid after closing
+    close( fd );
+  }
+
+  mapped_file::~mapped_file(){
+    /// unmap the file
+    if ( _data ){
+      munmap( const_cast<char*>(_data), _size );
+    }
+  }
+
 } // namespace TiCC
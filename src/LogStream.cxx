@@ -28,11 +28,27 @@
 #include "ticcutils/LogStream.h"
 
 #include <ctime>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
 
 #include <string>
+#include <stdexcept>
 #include <fstream>
+#include <sstream>
 #include <typeinfo>
+#include <map>
+#include <set>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
 #include <pthread.h>
+#include "ticcutils/json.hpp"
 
 #if defined __GNUC__
 #define DARE_TO_OPTIMIZE
@@ -47,21 +63,41 @@ using std::cerr;
 using std::endl;
 using std::bad_cast;
 using std::string;
+using std::vector;
 
 namespace TiCC {
   LogStream::LogStream( int ) :
     ostream( static_cast<streambuf *>(0) ),
     buf( cerr ),
-    single_threaded_mode(false){
+    single_threaded_mode(false),
+    async_mode(false),
+    log_format(LogText),
+    async_id(0),
+    my_proxy(0){
     /// create a LogStream  with an empty streambuf connected to cerr
   }
 
   LogStream null_stream( 0 ); /// fallback LogStream to cerr
 
+  /// @cond HIDDEN
+  namespace {
+  LogStream& inactive_stream(){
+    // the stream for inactive Log scopes. Writing to a stream without a
+    // streambuf still sets its state, so every thread gets its own
+    static thread_local LogStream inactive( 0 );
+    return inactive;
+  }
+  }
+  /// @endcond
+
   LogStream::LogStream() :
     ostream( &buf ),
     buf( cerr, "", StampBoth ),
-    single_threaded_mode(false) {
+    single_threaded_mode(false),
+    async_mode(false),
+    log_format(LogText),
+    async_id(0),
+    my_proxy(0){
     /// create a LogStream connected to cerr
   }
 
@@ -69,7 +105,11 @@ namespace TiCC {
 			LogFlag stamp ) :
     ostream( &buf ),
     buf( as, "", stamp ),
-    single_threaded_mode(false){
+    single_threaded_mode(false),
+    async_mode(false),
+    log_format(LogText),
+    async_id(0),
+    my_proxy(0){
     /// create a LogStream connected to an output stream
     /*!
       \param as a stream to connect to
@@ -83,7 +123,11 @@ namespace TiCC {
     buf( ls->buf.AssocStream(),
 	 ls->buf.Message(),
 	 ls->buf.StampFlag() ),
-    single_threaded_mode( ls->single_threaded_mode ){
+    single_threaded_mode( ls->single_threaded_mode ),
+    async_mode(false),
+    log_format(LogText),
+    async_id(0),
+    my_proxy(0){
     /// create a LogStream connected to a LogStream
     /*!
       \param ls a LogStream to connect to
@@ -91,6 +135,10 @@ namespace TiCC {
     */
     buf.Level( ls->buf.Level() );
     buf.Threshold( ls->buf.Threshold() );
+    if ( ls->async_mode ){
+      set_async_mode();
+    }
+    set_format( ls->log_format );
   }
 
   LogStream *LogStream::create( const string& filename,
@@ -257,6 +305,24 @@ namespace TiCC {
     }
   }
 
+  static bool holds_logging_mutex(){
+    /// does the current thread hold the logging mutex?
+    if ( !static_init ){
+      return false;
+    }
+    pthread_t me = pthread_self();
+    bool result = false;
+    pthread_mutex_lock( &global_lock_mutex );
+    for ( int i=0; i < MAX_LOCKS; i++ ){
+      if ( pthread_equal( locks[i].id, me ) ){
+	result = locks[i].cnt > 0;
+	break;
+      }
+    }
+    pthread_mutex_unlock( &global_lock_mutex );
+    return result;
+  }
+
   bool LogStream::IsBlocking(){
     /// is the current level below the threshold?
     if ( !bad() ){
@@ -271,6 +337,817 @@ namespace TiCC {
     }
   }
 
+  /// @cond HIDDEN
+  namespace {
+  /// the background writer for LogStreams in async mode.
+  ///
+  /// The logging threads push complete records on a lock-free multiple
+  /// producer, single consumer queue (the intrusive queue of D. Vyukov).
+  /// One writer thread drains the queue to the associated streams.
+  class async_writer {
+  public:
+    static async_writer *instance();
+    void push( ostream *, string&& );
+    void flush();
+  private:
+    struct record {
+      std::atomic<record*> next;
+      ostream *os;
+      string text;
+      bool *flushed;
+    };
+    async_writer();
+    ~async_writer();
+    void enqueue( record * );
+    record *pop();
+    bool empty() const;
+    size_t drain( vector<ostream*>& );
+    void run();
+    static std::atomic<bool> alive;
+    std::atomic<record*> head;
+    record *tail;
+    record stub;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::atomic<bool> idle;
+    bool stopping;
+    std::thread writer;
+  };
+
+  std::atomic<bool> async_writer::alive( false );
+
+  async_writer::async_writer():
+    head( &stub ),
+    tail( &stub ),
+    idle( false ),
+    stopping( false )
+  {
+    stub.next = 0;
+    stub.os = 0;
+    stub.flushed = 0;
+    writer = std::thread( &async_writer::run, this );
+    alive = true;
+  }
+
+  async_writer::~async_writer(){
+    /// write all pending records and stop the writer thread
+    alive = false;
+    {
+      std::lock_guard<std::mutex> guard( lock );
+      stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+  }
+
+  async_writer *async_writer::instance(){
+    /// return the writer. Or 0 when it is already gone, at program exit
+    static async_writer the_writer;
+    return alive ? &the_writer : 0;
+  }
+
+  void async_writer::enqueue( record *r ){
+    /// add a record to the queue. Safe to call from any thread.
+    r->next.store( 0, std::memory_order_relaxed );
+    record *prev = head.exchange( r );
+    prev->next.store( r, std::memory_order_release );
+    if ( idle.load() ){
+      // notify under the lock, so the writer can't miss it
+      std::lock_guard<std::mutex> guard( lock );
+      wake.notify_one();
+    }
+  }
+
+  async_writer::record *async_writer::pop(){
+    /// take the oldest record from the queue. Only used by the writer.
+    /*!
+      \return the record, or 0 when the queue is empty, or when a
+      producer is still busy linking in the next record
+    */
+    record *t = tail;
+    record *next = t->next.load( std::memory_order_acquire );
+    if ( t == &stub ){
+      if ( next == 0 ){
+	return 0;
+      }
+      tail = next;
+      t = next;
+      next = next->next.load( std::memory_order_acquire );
+    }
+    if ( next ){
+      tail = next;
+      return t;
+    }
+    if ( t != head.load( std::memory_order_acquire ) ){
+      return 0;
+    }
+    enqueue( &stub );
+    next = t->next.load( std::memory_order_acquire );
+    if ( next ){
+      tail = next;
+      return t;
+    }
+    return 0;
+  }
+
+  bool async_writer::empty() const {
+    return tail == &stub && head.load() == &stub;
+  }
+
+  void async_writer::push( ostream *os, string&& text ){
+    /// queue a record for output
+    /*!
+      \param os the stream to write to
+      \param text the formatted record
+    */
+    record *r = new record;
+    r->os = os;
+    r->text = std::move( text );
+    r->flushed = 0;
+    enqueue( r );
+  }
+
+  void async_writer::flush(){
+    /// wait until all records queued so far are written and flushed
+    bool flushed = false;
+    record *r = new record;
+    r->os = 0;
+    r->flushed = &flushed;
+    enqueue( r );
+    std::unique_lock<std::mutex> guard( lock );
+    wake.notify_one();
+    done.wait( guard, [&]{ return flushed; } );
+  }
+
+  size_t async_writer::drain( vector<ostream*>& touched ){
+    /// write out all available records
+    /*!
+      \param touched the streams written to, that need a flush
+      \return the number of records handled
+    */
+    size_t count = 0;
+    bool locked = false;
+    while ( record *r = pop() ){
+      ++count;
+      if ( r->os ){
+	if ( !locked ){
+	  // don't interfere with LogStreams in the normal, locking, mode
+	  pthread_mutex_lock( &global_logging_mutex );
+	  locked = true;
+	}
+	r->os->write( r->text.data(), r->text.size() );
+	if ( std::find( touched.begin(), touched.end(), r->os )
+	     == touched.end() ){
+	  touched.push_back( r->os );
+	}
+      }
+      else {
+	// a flush request
+	for ( const auto& os : touched ){
+	  os->flush();
+	}
+	touched.clear();
+	{
+	  std::lock_guard<std::mutex> guard( lock );
+	  *r->flushed = true;
+	}
+	done.notify_all();
+      }
+      delete r;
+    }
+    for ( const auto& os : touched ){
+      os->flush();
+    }
+    touched.clear();
+    if ( locked ){
+      pthread_mutex_unlock( &global_logging_mutex );
+    }
+    return count;
+  }
+
+  void async_writer::run(){
+    /// the writer thread
+    vector<ostream*> touched;
+    std::unique_lock<std::mutex> guard( lock );
+    while ( true ){
+      guard.unlock();
+      size_t count = drain( touched );
+      guard.lock();
+      if ( count == 0 ){
+	if ( stopping && empty() ){
+	  break;
+	}
+	// first announce that we want to sleep, then check the queue again.
+	// A producer either sees idle set, and notifies under the lock we
+	// hold until we wait, or we see its record here.
+	idle = true;
+	if ( empty() ){
+	  wake.wait( guard );
+	}
+	else {
+	  // a producer may still be linking in its record
+	  guard.unlock();
+	  std::this_thread::yield();
+	  guard.lock();
+	}
+	idle = false;
+      }
+    }
+  }
+  }
+
+  namespace {
+  /// a structured log record
+  struct log_record {
+    uint64_t time;
+    uint32_t thread;
+    LogLevel level;
+    string prefix;
+    string text;
+  };
+
+  const char *level_names[] = { "silent", "normal", "debug",
+				"heavy", "extreme" };
+
+  /// the ring buffer with the last structured log records of one thread
+  class log_ring {
+  public:
+    log_ring();
+    ~log_ring();
+    void add( uint64_t, LogLevel, const string&, const string& );
+    void dump( vector<log_record>& );
+    void dump( int );
+    uint32_t thread() const { return thread_nr; };
+    static log_ring& mine();
+    static std::atomic<size_t> ring_size;
+    static std::mutex registry_lock;
+    static std::atomic<bool> registry_busy;
+    static vector<log_ring*> registry;
+  private:
+    std::mutex lock;
+    // set while the records are changed, so the crash handler can skip
+    // them without waiting for the lock
+    std::atomic<bool> busy;
+    vector<log_record> records;
+    size_t next;
+    size_t filled;
+    uint32_t thread_nr;
+  };
+
+  std::atomic<size_t> log_ring::ring_size( 1024 );
+  std::mutex log_ring::registry_lock;
+  std::atomic<bool> log_ring::registry_busy( false );
+  vector<log_ring*> log_ring::registry;
+
+  log_ring::log_ring(): busy(false), next(0), filled(0){
+    static std::atomic<uint32_t> last_thread( 0 );
+    thread_nr = ++last_thread;
+    std::lock_guard<std::mutex> guard( registry_lock );
+    registry_busy = true;
+    registry.push_back( this );
+    registry_busy = false;
+  }
+
+  log_ring::~log_ring(){
+    std::lock_guard<std::mutex> guard( registry_lock );
+    registry_busy = true;
+    busy = true;
+    registry.erase( std::find( registry.begin(), registry.end(), this ) );
+    registry_busy = false;
+  }
+
+  log_ring& log_ring::mine(){
+    /// the ring buffer of the current thread
+    static thread_local log_ring ring;
+    return ring;
+  }
+
+  void log_ring::add( uint64_t time,
+		      LogLevel level,
+		      const string& prefix,
+		      const string& text ){
+    /// store a record, overwriting the oldest one when the ring is full
+    std::lock_guard<std::mutex> guard( lock );
+    busy = true;
+    size_t size = ring_size;
+    if ( records.size() != size ){
+      records.clear();
+      records.resize( size );
+      next = 0;
+      filled = 0;
+    }
+    if ( size == 0 ){
+      busy = false;
+      return;
+    }
+    // assign in place, to re-use the allocated strings
+    log_record& rec = records[next];
+    rec.time = time;
+    rec.thread = thread_nr;
+    rec.level = level;
+    rec.prefix = prefix;
+    rec.text = text;
+    next = ( next + 1 ) % size;
+    if ( filled < size ){
+      ++filled;
+    }
+    busy = false;
+  }
+
+  void log_ring::dump( vector<log_record>& result ){
+    /// append the stored records to result, oldest first
+    std::lock_guard<std::mutex> guard( lock );
+    if ( filled == 0 ){
+      return;
+    }
+    size_t start = ( next + records.size() - filled ) % records.size();
+    for ( size_t i=0; i < filled; ++i ){
+      result.push_back( records[( start + i ) % records.size()] );
+    }
+  }
+
+  /// write a string to a file descriptor, as part of a JSON string.
+  /// only uses async-signal-safe functions
+  void write_escaped( int fd, const char *s, size_t len ){
+    char buf[512];
+    size_t pos = 0;
+    for ( size_t i=0; i < len; ++i ){
+      if ( pos > sizeof(buf) - 8 ){
+	if ( write( fd, buf, pos ) < 0 ){
+	  return;
+	}
+	pos = 0;
+      }
+      unsigned char c = s[i];
+      if ( c == '"' || c == '\\' ){
+	buf[pos++] = '\\';
+	buf[pos++] = c;
+      }
+      else if ( c < 0x20 ){
+	static const char hex[] = "0123456789abcdef";
+	memcpy( buf + pos, "\\u00", 4 );
+	pos += 4;
+	buf[pos++] = hex[c >> 4];
+	buf[pos++] = hex[c & 0xf];
+      }
+      else {
+	buf[pos++] = c;
+      }
+    }
+    if ( pos > 0 && write( fd, buf, pos ) < 0 ){
+      return;
+    }
+  }
+
+  void write_number( int fd, uint64_t n ){
+    /// write a number, async-signal-safe
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    do {
+      *--p = '0' + n % 10;
+      n /= 10;
+    } while ( n > 0 );
+    if ( write( fd, p, buf + sizeof(buf) - p ) < 0 ){
+      return;
+    }
+  }
+
+  void write_string( int fd, const char *s ){
+    if ( write( fd, s, strlen( s ) ) < 0 ){
+      return;
+    }
+  }
+
+  void log_ring::dump( int fd ){
+    /// write the stored records as JSON lines to a file descriptor
+    /*!
+      \param fd the file descriptor
+      This is meant for a crash handler: it doesn't allocate memory and
+      doesn't take locks. A ring that is being changed is skipped.
+    */
+    if ( busy || filled == 0 ){
+      return;
+    }
+    size_t start = ( next + records.size() - filled ) % records.size();
+    for ( size_t i=0; i < filled; ++i ){
+      const log_record& rec = records[( start + i ) % records.size()];
+      write_string( fd, "{\"level\":\"" );
+      write_string( fd, level_names[rec.level] );
+      write_string( fd, "\",\"message\":\"" );
+      write_escaped( fd, rec.text.data(), rec.text.size() );
+      write_string( fd, "\",\"prefix\":\"" );
+      write_escaped( fd, rec.prefix.data(), rec.prefix.size() );
+      write_string( fd, "\",\"thread\":" );
+      write_number( fd, rec.thread );
+      write_string( fd, ",\"time\":" );
+      write_number( fd, rec.time );
+      write_string( fd, "}\n" );
+    }
+  }
+
+  string json_record( const log_record& rec ){
+    /// format a record as a JSON line
+    nlohmann::json j;
+    j["time"] = rec.time;
+    j["thread"] = rec.thread;
+    j["level"] = level_names[rec.level];
+    j["prefix"] = rec.prefix;
+    j["message"] = rec.text;
+    return j.dump( -1, ' ', false,
+		   nlohmann::json::error_handler_t::replace ) + "\n";
+  }
+
+  template <class T>
+  void append_binary( string& out, T value ){
+    out.append( reinterpret_cast<const char*>(&value), sizeof(T) );
+  }
+
+  string binary_record( const log_record& rec ){
+    /// format a record in the binary format:
+    /// uint32 length of the rest of the record, uint8 level, uint32 thread,
+    /// uint64 time in ns, uint16 length of the prefix, the prefix and the
+    /// text. All numbers in native byte order.
+    string result;
+    uint16_t prefix_len = std::min<size_t>( rec.prefix.size(), 0xffff );
+    uint32_t len = 1 + 4 + 8 + 2 + prefix_len + rec.text.size();
+    result.reserve( len + 4 );
+    append_binary( result, len );
+    append_binary( result, uint8_t(rec.level) );
+    append_binary( result, rec.thread );
+    append_binary( result, rec.time );
+    append_binary( result, prefix_len );
+    result.append( rec.prefix, 0, prefix_len );
+    result.append( rec.text );
+    return result;
+  }
+
+  string structured_record( LogFormat format,
+			    LogLevel level,
+			    const string& prefix,
+			    string& text ){
+    /// create a structured record and store it in the ring of this thread
+    /*!
+      \param format the format to output
+      \param level the level of the Log scope
+      \param prefix the message of the LogStream
+      \param text the text of the record. The final newline is removed.
+      \return the record formatted for output, or "" for LogRingOnly
+    */
+    if ( !text.empty() && text.back() == '\n' ){
+      text.pop_back();
+    }
+    log_record rec;
+    rec.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		 std::chrono::steady_clock::now().time_since_epoch() ).count();
+    log_ring& ring = log_ring::mine();
+    ring.add( rec.time, level, prefix, text );
+    if ( format == LogRingOnly ){
+      return "";
+    }
+    rec.thread = ring.thread();
+    rec.level = level;
+    rec.prefix = prefix;
+    rec.text = std::move( text );
+    if ( format == LogJson ){
+      return json_record( rec );
+    }
+    else {
+      return binary_record( rec );
+    }
+  }
+  }
+
+  /// the per thread buffer of a LogStream in async mode
+  struct LogStream::async_proxy {
+    explicit async_proxy( LogStream *ls ):
+      parent( ls ),
+      depth( 0 ),
+      stream( text, ls->get_stamp() )
+    {
+      stream.my_proxy = this;
+      stream.set_threshold( ls->get_threshold() );
+    }
+    LogStream *parent;
+    int depth; // the number of open Log scopes
+    std::ostringstream text;
+    LogStream stream;
+  };
+
+  namespace {
+  /// the ids of the LogStreams that may have proxies
+  struct proxy_registry {
+    std::mutex lock;
+    std::set<uint64_t> live;
+    std::atomic<uint64_t> generation;
+  };
+
+  proxy_registry& proxies_registry(){
+    // never destroyed, LogStreams may be destroyed at exit
+    static proxy_registry *reg = new proxy_registry();
+    return *reg;
+  }
+  }
+  /// @endcond
+
+  LogStream::~LogStream(){
+    /// destroy a LogStream, in async mode after writing all pending output
+    /*!
+      Inside a Log scope of a LogStream in normal mode, the background
+      writer can't get the logging mutex, so we don't wait for it. The
+      pending output is written later.
+    */
+    if ( async_mode && !holds_logging_mutex() ){
+      async_flush();
+    }
+    if ( async_id != 0 ){
+      // the proxies of this stream are now stale
+      proxy_registry& reg = proxies_registry();
+      std::lock_guard<std::mutex> guard( reg.lock );
+      reg.live.erase( async_id );
+      ++reg.generation;
+    }
+  }
+
+  /// @cond HIDDEN
+  static uint64_t new_proxy_id(){
+    static std::atomic<uint64_t> last_id( 0 );
+    uint64_t id = ++last_id;
+    proxy_registry& reg = proxies_registry();
+    std::lock_guard<std::mutex> guard( reg.lock );
+    reg.live.insert( id );
+    return id;
+  }
+  /// @endcond
+
+  bool LogStream::set_format( LogFormat format ){
+    /// set the output format
+    /*!
+      \param format the format. LogText is the normal text output, with
+      the stamps and message set for this stream. LogJson writes a JSON
+      line per Log scope, LogBinary a binary record, and LogRingOnly writes
+      nothing. For all but LogText, the records are also kept in the ring
+      buffer of the thread. See dump_log_rings()
+      \return true on succes
+    */
+    if ( my_proxy ){
+      return false;
+    }
+    if ( format != LogText && async_id == 0 ){
+      async_id = new_proxy_id();
+    }
+    log_format = format;
+    return true;
+  }
+
+  void set_log_ring_size( size_t size ){
+    /// set the number of structured records kept per thread
+    /*!
+      \param size the new size. Rings are cleared when resized
+    */
+    log_ring::ring_size = size;
+  }
+
+  void dump_log_rings( ostream& os ){
+    /// write the contents of all ring buffers as JSON lines, sorted on time
+    /*!
+      \param os the output stream
+    */
+    vector<log_record> records;
+    {
+      std::lock_guard<std::mutex> guard( log_ring::registry_lock );
+      for ( const auto& ring : log_ring::registry ){
+	ring->dump( records );
+      }
+    }
+    std::stable_sort( records.begin(), records.end(),
+		      []( const log_record& a, const log_record& b ){
+			return a.time < b.time; } );
+    for ( const auto& rec : records ){
+      os << json_record( rec );
+    }
+    os.flush();
+  }
+
+  /// @cond HIDDEN
+  namespace {
+  const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+  std::atomic<bool> crash_dumping( false );
+
+  void crash_handler( int sig ){
+    /// dump the ring buffers to stderr, then crash as intended
+    // only the first crashing thread dumps, and only when the registry
+    // isn't being changed. Waiting for a lock here could deadlock
+    if ( !crash_dumping.exchange( true ) && !log_ring::registry_busy ){
+      write_string( 2, "\n*** fatal signal, the last log records: ***\n" );
+      for ( const auto& ring : log_ring::registry ){
+	ring->dump( 2 );
+      }
+    }
+    signal( sig, SIG_DFL );
+    raise( sig );
+  }
+  }
+  /// @endcond
+
+  bool install_log_crash_handler(){
+    /// install signal handlers that dump the ring buffers on a crash
+    /*!
+      \return true on succes
+      On SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT the contents of the
+      ring buffers of all threads are written to stderr as JSON lines.
+    */
+    struct sigaction action;
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = crash_handler;
+    sigemptyset( &action.sa_mask );
+    action.sa_flags = SA_RESETHAND;
+    bool result = true;
+    for ( const auto& sig : crash_signals ){
+      if ( sigaction( sig, &action, 0 ) != 0 ){
+	result = false;
+      }
+    }
+    return result;
+  }
+
+  bool LogStream::set_async_mode( bool on ){
+    /// switch asynchronous logging on or off
+    /*!
+      \param on when true, switch async mode on, otherwise off
+      \return true on succes. Not possible in single threaded mode
+
+      In async mode, all Log, Dbg, xDbg and xxDbg objects on this stream
+      write into a buffer per thread. At the end of their scope the
+      buffered text is handed over to a background thread that writes it
+      to the associated stream.
+    */
+    if ( single_threaded_mode || my_proxy ){
+      return false;
+    }
+    if ( on == async_mode ){
+      return true;
+    }
+    if ( on ){
+      if ( !async_writer::instance() ){
+	return false;
+      }
+      if ( async_id == 0 ){
+	async_id = new_proxy_id();
+      }
+      async_mode = true;
+    }
+    else {
+      async_flush();
+      async_mode = false;
+    }
+    return true;
+  }
+
+  void LogStream::async_flush(){
+    /// wait until all output of this stream is written to the associated
+    /// stream
+    /*!
+      In async mode this blocks until the background writer has written
+      and flushed everything that was logged before the call. Inside a
+      Log scope of a LogStream in normal mode that would never end, so it
+      throws a logic_error then.
+    */
+    if ( async_mode ){
+      if ( holds_logging_mutex() ){
+	throw std::logic_error( "LogStream::async_flush() called inside a"
+				" Log scope of a LogStream in normal mode" );
+      }
+      async_writer *writer = async_writer::instance();
+      if ( writer ){
+	writer->flush();
+      }
+    }
+  }
+
+  LogStream *LogStream::thread_proxy(){
+    /// return the buffering LogStream of the current thread
+    static thread_local std::map<uint64_t,std::unique_ptr<async_proxy>> proxies;
+    static thread_local uint64_t generation = 0;
+    proxy_registry& reg = proxies_registry();
+    if ( generation != reg.generation ){
+      // some LogStreams are destroyed, remove their proxies
+      std::lock_guard<std::mutex> guard( reg.lock );
+      for ( auto it = proxies.begin(); it != proxies.end(); ){
+	if ( reg.live.find( it->first ) == reg.live.end() ){
+	  it = proxies.erase( it );
+	}
+	else {
+	  ++it;
+	}
+      }
+      generation = reg.generation;
+    }
+    auto& proxy = proxies[async_id];
+    if ( !proxy ){
+      proxy.reset( new async_proxy( this ) );
+    }
+    LogStream& result = proxy->stream;
+    if ( proxy->depth > 0 ){
+      // a nested scope, continuing the same record
+      return &result;
+    }
+    result.set_level( get_level() );
+    // structured records get no text stamps
+    result.set_stamp( log_format == LogText ? get_stamp() : NoStamp );
+    if ( result.get_message() != get_message() ){
+      result.set_message( get_message() );
+    }
+    return &result;
+  }
+
+  LogStream *LogStream::open_scope( LogLevel threshold, LogLevel& old ){
+    /// start a Log scope on this stream
+    /*!
+      \param threshold the threshold for the scope
+      \param old the current threshold, to restore at the end of the scope
+      \return the stream to use within the scope
+    */
+    if ( get_level() < threshold || bad() ){
+      // nothing will be output, so no need to lock or buffer anything
+      return &inactive_stream();
+    }
+    LogStream *result = this;
+    if ( !my_proxy
+	 && ( log_format != LogText
+	      || ( async_mode && async_writer::instance() ) ) ){
+      result = thread_proxy();
+    }
+    else if ( !my_proxy && !single_threaded_mode ){
+      init_mutex();
+    }
+    if ( result->my_proxy ){
+      // a proxy is private to this thread, no locking needed
+      ++result->my_proxy->depth;
+    }
+    old = result->get_threshold();
+    result->set_threshold( threshold );
+    return result;
+  }
+
+  void LogStream::close_scope( LogLevel old ){
+    /// end a Log scope on this stream
+    /*!
+      \param old the threshold to restore
+    */
+    if ( this == &inactive_stream() ){
+      // an inactive scope
+      return;
+    }
+    flush();
+    LogLevel level = get_threshold();
+    set_threshold( old );
+    if ( my_proxy ){
+      if ( --my_proxy->depth > 0 ){
+	// only the outermost scope ends the record
+	return;
+      }
+      string record = my_proxy->text.str();
+      if ( !record.empty() ){
+	my_proxy->text.str( "" );
+	LogStream *parent = my_proxy->parent;
+	if ( parent->log_format != LogText ){
+	  record = structured_record( parent->log_format, level,
+				      get_message(), record );
+	}
+	if ( !record.empty() ){
+	  parent->write_record( std::move( record ) );
+	}
+      }
+    }
+    else if ( !single_threaded_mode ){
+      mutex_release();
+    }
+  }
+
+  void LogStream::write_record( string&& record ){
+    /// write a complete record to the associated stream
+    /*!
+      \param record the record
+      In async mode the background writer does the writing.
+    */
+    async_writer *writer = async_mode ? async_writer::instance() : 0;
+    if ( writer ){
+      writer->push( &buf.AssocStream(), std::move( record ) );
+    }
+    else {
+      if ( !single_threaded_mode ){
+	init_mutex();
+      }
+      buf.AssocStream().write( record.data(), record.size() );
+      buf.AssocStream().flush();
+      if ( !single_threaded_mode ){
+	mutex_release();
+      }
+    }
+  }
+
   bool IsActive( LogStream &ls ){
     /// is the current level above the threshold, meaning this stream is active
     return !ls.IsBlocking();
@@ -287,29 +1164,17 @@ namespace TiCC {
     if ( !os ){
       throw( "LogStreams FATAL error: No Stream supplied! " );
     }
-    if ( os->single_threaded() || init_mutex() ){
-      my_level = os->get_threshold();
-      my_stream = os;
-      os->set_threshold( LogNormal );
-    }
+    my_stream = os->open_scope( LogNormal, my_level );
   }
 
   Log::Log( LogStream& os ):  my_stream(0), my_level(LogSilent){
     /// create a Log object on the LogStream with Normal threshold
-    if ( os.single_threaded() || init_mutex() ){
-      my_stream = &os;
-      my_level = os.get_threshold();
-      os.set_threshold( LogNormal );
-    }
+    my_stream = os.open_scope( LogNormal, my_level );
   }
 
   Log::~Log(){
     /// destroy the Log object
-    my_stream->flush();
-    my_stream->set_threshold( my_level );
-    if ( !my_stream->single_threaded() ){
-      mutex_release();
-    }
+    my_stream->close_scope( my_level );
   }
 
   LogStream& Log::operator *(){
@@ -319,7 +1184,7 @@ namespace TiCC {
       return *my_stream;
     }
     else {
-      return null_stream;
+      return inactive_stream();
     }
 #else
     return *my_stream;
@@ -331,29 +1196,17 @@ namespace TiCC {
     if ( !os ){
       throw( "LogStreams FATAL error: No Stream supplied! " );
     }
-    if ( os->single_threaded() || init_mutex() ){
-      my_stream = os;
-      my_level = os->get_threshold();
-      os->set_threshold( LogDebug );
-    }
+    my_stream = os->open_scope( LogDebug, my_level );
   }
 
   Dbg::Dbg( LogStream& os ):  my_stream(0), my_level(LogSilent){
     /// create a Dbg object on the LogStream with Debug threshold
-    if ( os.single_threaded() || init_mutex() ){
-      my_stream = &os;
-      my_level = os.get_threshold();
-      os.set_threshold( LogDebug );
-    }
+    my_stream = os.open_scope( LogDebug, my_level );
   }
 
   Dbg::~Dbg(){
     /// destroy the Dbg object
-    my_stream->flush();
-    my_stream->set_threshold( my_level );
-    if ( !my_stream->single_threaded() ){
-      mutex_release();
-    }
+    my_stream->close_scope( my_level );
   }
 
   LogStream& Dbg::operator *() {
@@ -363,7 +1216,7 @@ namespace TiCC {
       return *my_stream;
     }
     else {
-      return null_stream;
+      return inactive_stream();
     }
 #else
     return *my_stream;
@@ -375,29 +1228,17 @@ namespace TiCC {
     if ( !os ){
       throw( "LogStreams FATAL error: No Stream supplied! " );
     }
-    if ( os->single_threaded() || init_mutex() ){
-      my_stream = os;
-      my_level = os->get_threshold();
-      os->set_threshold( LogHeavy );
-    }
+    my_stream = os->open_scope( LogHeavy, my_level );
   }
 
   xDbg::xDbg( LogStream& os ):  my_stream(0), my_level(LogSilent){
     /// create a xDbg object on the LogStream with Heavy threshold
-    if ( os.single_threaded() || init_mutex() ){
-      my_stream = &os;
-      my_level = os.get_threshold();
-      os.set_threshold( LogHeavy );
-    }
+    my_stream = os.open_scope( LogHeavy, my_level );
   }
 
   xDbg::~xDbg(){
     /// destroy the xDbg object
-    my_stream->flush();
-    my_stream->set_threshold( my_level );
-    if ( !my_stream->single_threaded() ){
-      mutex_release();
-    }
+    my_stream->close_scope( my_level );
   }
 
   LogStream& xDbg::operator *(){
@@ -407,7 +1248,7 @@ namespace TiCC {
       return *my_stream;
     }
     else {
-      return null_stream;
+      return inactive_stream();
     }
 #else
     return *my_stream;
@@ -419,29 +1260,17 @@ namespace TiCC {
     if ( !os ){
       throw( "LogStreams FATAL error: No Stream supplied! " );
     }
-    if ( os->single_threaded() || init_mutex() ){
-      my_stream = os;
-      my_level = os->get_threshold();
-      os->set_threshold( LogExtreme );
-    }
+    my_stream = os->open_scope( LogExtreme, my_level );
   }
 
   xxDbg::xxDbg( LogStream& os ):  my_stream(0), my_level(LogSilent){
     /// create a xxDbg object on the LogStream with Extreme threshold
-    if ( os.single_threaded() || init_mutex() ){
-      my_stream = &os;
-      my_level = os.get_threshold();
-      os.set_threshold( LogExtreme );
-    }
+    my_stream = os.open_scope( LogExtreme, my_level );
   }
 
   xxDbg::~xxDbg(){
     /// destroy the xxDbg object
-    my_stream->flush();
-    my_stream->set_threshold( my_level );
-    if ( !my_stream->single_threaded() ){
-      mutex_release();
-    }
+    my_stream->close_scope( my_level );
   }
 
   LogStream& xxDbg::operator *(){
@@ -451,7 +1280,7 @@ namespace TiCC {
       return *my_stream;
     }
     else {
-      return null_stream;
+      return inactive_stream();
     }
 #else
     return *my_stream;
@@ -34,6 +34,11 @@
 #include <sstream>
 #include "ticcutils/Version.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TICC_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 using namespace std;
 namespace TiCC {
 
@@ -44,6 +49,251 @@ namespace TiCC {
       + __DATE__ + " " + __TIME__;
   }
 
+  /// @cond HIDDEN
+  //
+  // Vectorized kernels for scanning and case conversion.
+  //
+  // On x86_64 SSE2 is always available, AVX2 is used when the CPU has it.
+  // The kernels compare each block of bytes with every character of a
+  // (small) set, so they are only used for sets of at most MAX_SET
+  // characters, and for inputs long enough to fill a block. Everything
+  // else takes the plain std:: route. The results are the same in all
+  // cases.
+  //
+  static const size_t MAX_SET = 8;
+
+  struct byte_set {
+    explicit byte_set( const string_view& set ): size( set.size() ){
+      set.copy( chars, MAX_SET );
+    }
+    bool contains( char c ) const {
+      for ( size_t k=0; k < size; ++k ){
+	if ( chars[k] == c ){
+	  return true;
+	}
+      }
+      return false;
+    }
+    size_t size;
+    char chars[MAX_SET];
+  };
+
+#ifdef TICC_SIMD_X86
+  static bool have_avx2(){
+    static const bool avx2 = __builtin_cpu_supports( "avx2" );
+    return avx2;
+  }
+
+  static inline unsigned int sse2_match( const __m128i& block,
+					 const byte_set& set ){
+    // a bit for every byte in block which is in the set
+    __m128i m = _mm_cmpeq_epi8( block, _mm_set1_epi8( set.chars[0] ) );
+    for ( size_t k=1; k < set.size; ++k ){
+      m = _mm_or_si128( m, _mm_cmpeq_epi8( block,
+					   _mm_set1_epi8( set.chars[k] ) ) );
+    }
+    return static_cast<unsigned int>( _mm_movemask_epi8( m ) );
+  }
+
+  __attribute__((target("avx2")))
+  static inline unsigned int avx2_match( const __m256i& block,
+					 const byte_set& set ){
+    __m256i m = _mm256_cmpeq_epi8( block, _mm256_set1_epi8( set.chars[0] ) );
+    for ( size_t k=1; k < set.size; ++k ){
+      m = _mm256_or_si256( m,
+			   _mm256_cmpeq_epi8( block,
+					      _mm256_set1_epi8( set.chars[k] ) ) );
+    }
+    return static_cast<unsigned int>( _mm256_movemask_epi8( m ) );
+  }
+
+  static size_t sse2_find( const char *p, size_t len,
+			   const byte_set& set, bool in_set ){
+    // the first position in p which is (or is not) in the set, or len
+    const unsigned int flip = in_set ? 0 : 0xFFFF;
+    size_t i = 0;
+    for ( ; i + 16 <= len; i += 16 ){
+      __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p+i) );
+      unsigned int bits = sse2_match( block, set ) ^ flip;
+      if ( bits ){
+	return i + __builtin_ctz( bits );
+      }
+    }
+    for ( ; i < len; ++i ){
+      if ( set.contains( p[i] ) == in_set ){
+	return i;
+      }
+    }
+    return len;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t avx2_find( const char *p, size_t len,
+			   const byte_set& set, bool in_set ){
+    const unsigned int flip = in_set ? 0 : 0xFFFFFFFF;
+    size_t i = 0;
+    for ( ; i + 32 <= len; i += 32 ){
+      __m256i block = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(p+i) );
+      unsigned int bits = avx2_match( block, set ) ^ flip;
+      if ( bits ){
+	return i + __builtin_ctz( bits );
+      }
+    }
+    return i + sse2_find( p + i, len - i, set, in_set );
+  }
+
+  static size_t sse2_rfind( const char *p, size_t len,
+			    const byte_set& set, bool in_set ){
+    // one past the last position in p which is (or is not) in the set,
+    // or 0
+    const unsigned int flip = in_set ? 0 : 0xFFFF;
+    size_t i = len;
+    for ( ; i >= 16; i -= 16 ){
+      __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p+i-16) );
+      unsigned int bits = sse2_match( block, set ) ^ flip;
+      if ( bits ){
+	return i - 16 + 32 - __builtin_clz( bits );
+      }
+    }
+    for ( ; i > 0; --i ){
+      if ( set.contains( p[i-1] ) == in_set ){
+	return i;
+      }
+    }
+    return 0;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t avx2_rfind( const char *p, size_t len,
+			    const byte_set& set, bool in_set ){
+    const unsigned int flip = in_set ? 0 : 0xFFFFFFFF;
+    size_t i = len;
+    for ( ; i >= 32; i -= 32 ){
+      __m256i block = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(p+i-32) );
+      unsigned int bits = avx2_match( block, set ) ^ flip;
+      if ( bits ){
+	return i - 32 + 32 - __builtin_clz( bits );
+      }
+    }
+    return sse2_rfind( p, i, set, in_set );
+  }
+
+  static void sse2_case( char *p, size_t len, bool upper ){
+    // convert the ASCII letters in p. Non-ASCII bytes are left to the C
+    // library, as the locale decides about those.
+    const char first = upper ? 'a' : 'A';
+    // shift the letters to the bottom of the signed range, so one signed
+    // compare finds them
+    const __m128i shift = _mm_set1_epi8( static_cast<char>( 0x80 - first ) );
+    const __m128i limit = _mm_set1_epi8( static_cast<char>( 0x80 + 26 ) );
+    const __m128i flip = _mm_set1_epi8( 0x20 );
+    size_t i = 0;
+    for ( ; i + 16 <= len; i += 16 ){
+      __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p+i) );
+      // non-ASCII bytes are never seen as a letter here
+      __m128i letter = _mm_cmplt_epi8( _mm_add_epi8( block, shift ), limit );
+      _mm_storeu_si128( reinterpret_cast<__m128i*>(p+i),
+			_mm_xor_si128( block, _mm_and_si128( letter, flip ) ) );
+      unsigned int high = _mm_movemask_epi8( block );
+      while ( high ){
+	const size_t j = i + __builtin_ctz( high );
+	p[j] = upper ? toupper( p[j] ) : tolower( p[j] );
+	high &= high - 1;
+      }
+    }
+    for ( ; i < len; ++i ){
+      p[i] = upper ? toupper( p[i] ) : tolower( p[i] );
+    }
+  }
+
+  __attribute__((target("avx2")))
+  static void avx2_case( char *p, size_t len, bool upper ){
+    const char first = upper ? 'a' : 'A';
+    const __m256i shift = _mm256_set1_epi8( static_cast<char>( 0x80 - first ) );
+    const __m256i limit = _mm256_set1_epi8( static_cast<char>( 0x80 + 26 ) );
+    const __m256i flip = _mm256_set1_epi8( 0x20 );
+    size_t i = 0;
+    for ( ; i + 32 <= len; i += 32 ){
+      __m256i block = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(p+i) );
+      __m256i letter = _mm256_cmpgt_epi8( limit,
+					  _mm256_add_epi8( block, shift ) );
+      _mm256_storeu_si256( reinterpret_cast<__m256i*>(p+i),
+			   _mm256_xor_si256( block,
+					     _mm256_and_si256( letter, flip ) ) );
+      unsigned int high = _mm256_movemask_epi8( block );
+      while ( high ){
+	const size_t j = i + __builtin_ctz( high );
+	p[j] = upper ? toupper( p[j] ) : tolower( p[j] );
+	high &= high - 1;
+      }
+    }
+    sse2_case( p + i, len - i, upper );
+  }
+#endif
+
+  static string_view::size_type scan_first( const string_view& s,
+					    const string_view& set,
+					    bool in_set,
+					    string_view::size_type pos = 0 ){
+    /// the same as s.find_first_of( set, pos ) (in_set = true) or
+    /// s.find_first_not_of( set, pos ) (in_set = false)
+#ifdef TICC_SIMD_X86
+    if ( pos < s.size()
+	 && s.size() - pos >= 16
+	 && !set.empty()
+	 && set.size() <= MAX_SET ){
+      const byte_set bs( set );
+      const size_t len = s.size() - pos;
+      size_t found = have_avx2() ? avx2_find( s.data() + pos, len, bs, in_set )
+	: sse2_find( s.data() + pos, len, bs, in_set );
+      return found == len ? string_view::npos : pos + found;
+    }
+#endif
+    return in_set ? s.find_first_of( set, pos ) : s.find_first_not_of( set, pos );
+  }
+
+  static string_view::size_type scan_last_not( const string_view& s,
+					       const string_view& set ){
+    /// the same as s.find_last_not_of( set )
+#ifdef TICC_SIMD_X86
+    if ( s.size() >= 16
+	 && !set.empty()
+	 && set.size() <= MAX_SET ){
+      const byte_set bs( set );
+      size_t end = have_avx2() ? avx2_rfind( s.data(), s.size(), bs, false )
+	: sse2_rfind( s.data(), s.size(), bs, false );
+      return end == 0 ? string_view::npos : end - 1;
+    }
+#endif
+    return s.find_last_not_of( set );
+  }
+
+  static bool plain_ascii_case(){
+    // the vector case conversion only knows the ASCII rules. Some locales
+    // (e.g. Turkish) have other ideas about 'I' and 'i'
+    return tolower( 'I' ) == 'i' && toupper( 'i' ) == 'I';
+  }
+
+  static void convert_case( string& s, bool upper ){
+    /// convert \e s to upper- or lowercase, in place. Gives the same result
+    /// as calling toupper() or tolower() on every byte.
+#ifdef TICC_SIMD_X86
+    if ( s.size() >= 16 && plain_ascii_case() ){
+      if ( have_avx2() ){
+	avx2_case( &s[0], s.size(), upper );
+      }
+      else {
+	sse2_case( &s[0], s.size(), upper );
+      }
+      return;
+    }
+#endif
+    for ( auto& c : s ){
+      c = upper ? toupper( c ) : tolower( c );
+    }
+  }
+  /// @endcond
+
   string trim( const string& s, const string& chars ){
     /// remove leading and trailing characters from a string
     /*!
@@ -53,11 +303,11 @@ namespace TiCC {
     */
     string result;
     if ( !s.empty() ){
-      string::size_type b_pos = s.find_first_not_of( chars );
+      string::size_type b_pos = scan_first( s, chars, false );
       if ( b_pos == string::npos ){
 	return result; // 'empty' string. only garbage
       }
-      string::size_type e_pos = s.find_last_not_of( chars );
+      string::size_type e_pos = scan_last_not( s, chars );
       if ( e_pos == string::npos ){
 	result = s.substr( b_pos );
       }
@@ -77,7 +327,7 @@ namespace TiCC {
     */
     string result;
     if ( !s.empty() ){
-      string::size_type b_pos = s.find_first_not_of( chars );
+      string::size_type b_pos = scan_first( s, chars, false );
       if ( b_pos != string::npos ){
 	result = s.substr( b_pos );
       }
@@ -94,7 +344,7 @@ namespace TiCC {
     */
     string result;
     if ( !s.empty() ){
-      string::size_type e_pos = s.find_last_not_of( chars );
+      string::size_type e_pos = scan_last_not( s, chars );
       if ( e_pos != string::npos ){
 	result = s.substr( 0, e_pos+1 );
       }
@@ -102,6 +352,48 @@ namespace TiCC {
     return result;
   }
 
+  void trim_inplace( string& s, const string& chars ){
+    /// remove leading and trailing characters from a string, in place
+    /*!
+      \param s the string to trim. Is modified.
+      \param chars the characters to remove. The default is whitespace.
+
+      Gives the same result as s = trim( s, chars ), without allocating.
+    */
+    trim_back_inplace( s, chars );
+    trim_front_inplace( s, chars );
+  }
+
+  void trim_front_inplace( string& s, const string& chars ){
+    /// remove leading characters from a string, in place
+    /*!
+      \param s the string to trim. Is modified.
+      \param chars the characters to remove. The default is whitespace.
+    */
+    string::size_type b_pos = scan_first( s, chars, false );
+    if ( b_pos == string::npos ){
+      s.clear();
+    }
+    else if ( b_pos > 0 ){
+      s.erase( 0, b_pos );
+    }
+  }
+
+  void trim_back_inplace( string& s, const string& chars ){
+    /// remove trailing characters from a string, in place
+    /*!
+      \param s the string to trim. Is modified.
+      \param chars the characters to remove. The default is whitespace.
+    */
+    string::size_type e_pos = scan_last_not( s, chars );
+    if ( e_pos == string::npos ){
+      s.clear();
+    }
+    else {
+      s.erase( e_pos+1 );
+    }
+  }
+
   string pad( const string& in, size_t len, const char pad_char ){
     if ( len <= in.length() ){
       return in;
@@ -113,17 +405,26 @@ namespace TiCC {
     }
   }
 
-  static int toLower( const int& i ){ return tolower(i); }
-  static int toUpper( const int& i ){ return toupper(i); }
+  void pad_inplace( string& s, size_t len, const char pad_char ){
+    /// pad a string at the front to length \e len, in place
+    /*!
+      \param s the string to pad. Is modified.
+      \param len the wanted length. Longer strings are left alone.
+      \param pad_char the character to pad with.
+    */
+    if ( len > s.length() ){
+      s.insert( size_t(0), len - s.length(), pad_char );
+    }
+  }
 
   void to_lower( string& s ){
     /// convert to all lowercase. Modifies the input.
-    transform( s.begin(), s.end(), s.begin(), toLower );
+    convert_case( s, false );
   }
 
   void to_upper( string& s ){
     /// convert to all uppercase. Modifies the input.
-    transform( s.begin(), s.end(), s.begin(), toUpper );
+    convert_case( s, true );
   }
 
   string lowercase( const string& s ){
@@ -133,6 +434,28 @@ namespace TiCC {
     return result;
   }
 
+  void lowercase_into( const string& in, string& out ){
+    /// store a lowercased copy of \e in into \e out
+    /*!
+      \param in the string to convert
+      \param out the result. Its buffer is reused, so when it is big
+      enough, nothing is allocated.
+    */
+    out.assign( in );
+    to_lower( out );
+  }
+
+  void uppercase_into( const string& in, string& out ){
+    /// store an uppercased copy of \e in into \e out
+    /*!
+      \param in the string to convert
+      \param out the result. Its buffer is reused, so when it is big
+      enough, nothing is allocated.
+    */
+    out.assign( in );
+    to_upper( out );
+  }
+
   string uppercase( const string& s ){
     /// return a uppercased copy of the inputstring
     string result = s;
@@ -173,162 +496,124 @@ namespace TiCC {
     return false;
   }
 
-  static vector<string> local_split_at( const string& src,
-					const string& sep,
-					bool exact ){
-    /// split a string into substrings.
-    /*!
-      \param src the string to split
-      \param sep a separator string. This may be a multi-character string.
-      \param exact normally, we silently skip empty entries (e.g. when two or
-      more separators co-incide), but not when exact=true. In that case result
-      may contain empty strings.
-      \return a vector of substrings
-    */
-    if ( sep.empty() ){
-      throw runtime_error( "TiCC::split_at(): separator is empty!" );
-    }
-    vector<string> results;
-    string::size_type pos = 0;
-    while ( pos != string::npos ){
-      string res;
-      string::size_type p = src.find( sep, pos );
-      if ( p == string::npos ){
-	res = src.substr( pos );
-	pos = p;
-      }
-      else {
-	res = src.substr( pos, p - pos );
-	pos = p + sep.length();
-      }
-      if ( !res.empty() || exact ){
-	results.push_back( res );
-      }
+  /// @cond HIDDEN
+  static inline string_view::size_type find_sep( const string_view& src,
+						 const string_view& seps,
+						 bool first_of,
+						 string_view::size_type pos ){
+    /// find the next separator in \e src, from \e pos on
+    if ( first_of && seps.length() > 1 ){
+      return scan_first( src, seps, true, pos );
     }
-    return results;
+    // one separator: find() is a lot faster then find_first_of()
+    return src.find( seps, pos );
   }
 
-  static vector<string> local_split_at( const string& src,
-					const string& sep,
-					size_t max ){
-    /// split a string into substrings.
+  template <class Emit>
+  static void split_core( const string_view& src,
+			  const string_view& seps,
+			  bool first_of,
+			  bool exact,
+			  size_t max,
+			  Emit emit ){
+    /// the one splitting loop for all the split functions
     /*!
       \param src the string to split
-      \param sep a separator string. May be a multi-character string.
-      \param max if max > 0, limit the size of the result to \e max strings,
+      \param seps the separator(s)
+      \param first_of when true, split at any of the characters in \e seps,
+      otherwise \e seps is one (multi-character) separator
+      \param exact normally, we silently skip empty entries (e.g. when two or
+      more separators co-incide), but not when exact=true.
+      \param max if max > 0, limit the size of the result to \e max parts,
       leaving the remainder in the last part of the result
-      \return a vector of split parts
+      \param emit called with a string_view on every part
     */
-    if ( sep.empty() ){
-      throw runtime_error( "TiCC::split_at(): separator is empty!" );
-    }
-    vector<string> results;
+    const size_t sep_len = first_of ? 1 : seps.length();
     size_t cnt = 0;
-    string::size_type pos = 0;
-    while ( pos != string::npos ){
-      string res;
-      string::size_type p = src.find( sep, pos );
-      if ( p == string::npos ){
+    string_view::size_type pos = 0;
+    while ( pos != string_view::npos ){
+      string_view res;
+      string_view::size_type e = find_sep( src, seps, first_of, pos );
+      if ( e == string_view::npos ){
 	res = src.substr( pos );
-	pos = p;
+	pos = e;
       }
       else {
-	res = src.substr( pos, p - pos );
-	pos = p + sep.length();
+	res = src.substr( pos, e - pos );
+	pos = e + sep_len;
       }
-      if ( !res.empty() ){
+      if ( !res.empty() || exact ){
 	++cnt;
-	results.push_back( res );
+	emit( res );
       }
       if ( max != 0 && cnt >= max-1 ){
-	if ( pos != string::npos ){
-	  results.push_back( src.substr( pos ) );
+	if ( pos != string_view::npos ){
+	  emit( src.substr( pos ) );
 	}
 	break;
       }
     }
-    return results;
   }
+  /// @endcond
 
-  static vector<string> local_split_at_first_of( const string& src,
-						 const string& seps,
-						 bool exact ){
+  static vector<string> local_split( const string& src,
+				     const string& seps,
+				     bool first_of,
+				     bool exact,
+				     size_t max ){
     /// split a string into substrings.
     /*!
       \param src the string to split
-      \param seps a string with separator characters. one of those should match
-      for a split to happen.
-      \param exact normally, we silently skip empty entries (e.g. when two or
-      more separators co-incide), but not when exact=true. In that case result
-      may contain empty strings.
+      \param seps the separator(s)
+      \param first_of when true, split at any of the characters in \e seps,
+      otherwise \e seps is one (multi-character) separator
+      \param exact when true, keep empty parts
+      \param max if max > 0, limit the size of the result to \e max strings,
+      leaving the remainder in the last part of the result
       \return a vector of split parts
     */
     if ( seps.empty() ){
-      throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
-    }
-    vector<string> results;
-    string::size_type s = 0;
-    while ( s != string::npos ){
-      string res;
-      string::size_type e = src.find_first_of( seps, s );
-      if ( e == string::npos ){
-	res = src.substr( s );
-	s = e;
-      }
-      else {
-	res = src.substr( s, e - s );
-	s = e+1;
-      }
-      if ( !res.empty() || exact ){
-	results.push_back( res );
+      if ( first_of ){
+	throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
       }
+      throw runtime_error( "TiCC::split_at(): separator is empty!" );
     }
+    vector<string> results;
+    split_core( src, seps, first_of, exact, max,
+		[&]( const string_view& part ){
+		  results.emplace_back( part );
+		} );
     return results;
   }
 
-  static vector<string> local_split_at_first_of( const string& src,
-						 const string& seps,
-						 size_t max ){
-    /// split a string into substrings.
+  static size_t local_split( const string_view& src,
+			     vector<string_view>& results,
+			     const string_view& seps,
+			     bool first_of,
+			     bool exact,
+			     size_t max ){
+    /// split a string into views on its parts
     /*!
-      \param src the string to split
-      \param seps a string with separator characters. one of those should match
-      for a split to happen.
-      \param max if max > 0, limit the size of the result to \e max strings,
-      leaving the remainder in the last part of the result
-      \return a vector of split parts
+      the same as above, but fills the vector \e results (which is cleared
+      first) with views into \e src.
+      \return the number of parts
     */
     if ( seps.empty() ){
-      throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
-    }
-    vector<string> results;
-    size_t cnt = 0;
-    string::size_type pos = 0;
-    while ( pos != string::npos ){
-      string res;
-      string::size_type e = src.find_first_of( seps, pos );
-      if ( e == string::npos ){
-	res = src.substr( pos );
-	pos = e;
-      }
-      else {
-	res = src.substr( pos, e - pos );
-	pos = e+1;
-      }
-      if ( !res.empty() ){
-	results.push_back( res );
-	++cnt;
-      }
-      if ( max != 0 && cnt >= max-1 ){
-	if ( pos != string::npos ){
-	  results.push_back( src.substr( pos ) );
-	}
-	break;
+      if ( first_of ){
+	throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
       }
+      throw runtime_error( "TiCC::split_at(): separator is empty!" );
     }
-    return results;
+    results.clear();
+    split_core( src, seps, first_of, exact, max,
+		[&]( const string_view& part ){
+		  results.push_back( part );
+		} );
+    return results.size();
   }
 
+  static const string_view spaces = " \r\t\n";
+
   vector<string> split_at( const string& src,
 			   const string& sep,
 			   size_t max ){
@@ -340,71 +625,221 @@ namespace TiCC {
       leaving the remainder in the last part of the result
       \return a vector of split parts
     */
-    return local_split_at( src, sep, max );
+    return local_split( src, sep, false, false, max );
   }
 
   size_t split_at( const string& s,
 		   vector<string>& v,
 		   const string& seps ){
-    v = local_split_at( s, seps, false );
+    v = local_split( s, seps, false, false, 0 );
     return v.size();
   }
 
   vector<string> split( const string& s,
 				  size_t num ){
-    return local_split_at_first_of( s, " \r\t\n", num );
+    return local_split( s, " \r\t\n", true, false, num );
   }
 
   vector<string> split_at_first_of( const string& s,
 				    const string& seps,
 				    size_t num ){
-    return local_split_at_first_of( s, seps, num );
+    return local_split( s, seps, true, false, num );
   }
 
   size_t split_at_first_of( const string& s,
 			    vector<string>& v,
 			    const string& seps ){
-    v = local_split_at_first_of( s, seps, false );
+    v = local_split( s, seps, true, false, 0 );
     return v.size();
   }
 
   size_t split( const string& s,
 		vector<string>& v ){
-    v = local_split_at_first_of( s, " \r\t\n", false );
+    v = local_split( s, " \r\t\n", true, false, 0 );
     return v.size();
   }
 
   size_t split_exact( const string& s,
 		      vector<string>& v ){
-    v = local_split_at_first_of( s, " \r\t\n", true );
+    v = local_split( s, " \r\t\n", true, true, 0 );
     return v.size();
   }
 
   size_t split_exact_at( const string& s,
 			 vector<string>& v,
 			 const string& m ){
-    v = local_split_at( s, m, true );
+    v = local_split( s, m, false, true, 0 );
     return v.size();
   }
 
   size_t split_exact_at_first_of( const string& s,
 				  vector<string>& v,
 				  const string& m ){
-    v = local_split_at_first_of( s, m, true );
+    v = local_split( s, m, true, true, 0 );
     return v.size();
   }
 
-  string join( const vector<string>& vec, const string& sep ){
-    string result;
+  size_t split( const string_view& s,
+		vector<string_view>& v,
+		size_t num ){
+    /// split a string at whitespace into views on its parts
+    /*!
+      \param s the string to split
+      \param v the resulting parts. These are views into \e s, so they are
+      only valid as long as \e s is. \e v is cleared first, but keeps its
+      capacity, so it can be reused without allocating.
+      \param num if num > 0, limit the size of the result to \e num parts,
+      leaving the remainder in the last part of the result
+      \return the number of parts
+    */
+    return local_split( s, v, spaces, true, false, num );
+  }
+
+  size_t split_at( const string_view& s,
+		   vector<string_view>& v,
+		   const string_view& sep,
+		   size_t num ){
+    /// split a string at a (multi-character) separator into views on its
+    /// parts. See split() for the parameters.
+    return local_split( s, v, sep, false, false, num );
+  }
+
+  size_t split_at_first_of( const string_view& s,
+			    vector<string_view>& v,
+			    const string_view& seps,
+			    size_t num ){
+    /// split a string at any of the characters in \e seps into views on its
+    /// parts. See split() for the parameters.
+    return local_split( s, v, seps, true, false, num );
+  }
+
+  size_t split_exact( const string_view& s,
+		      vector<string_view>& v,
+		      size_t num ){
+    /// split a string at whitespace into views on its parts, keeping empty
+    /// parts. See split() for the parameters.
+    return local_split( s, v, spaces, true, true, num );
+  }
+
+  size_t split_exact_at( const string_view& s,
+			 vector<string_view>& v,
+			 const string_view& sep,
+			 size_t num ){
+    /// split a string at a (multi-character) separator into views on its
+    /// parts, keeping empty parts. See split() for the parameters.
+    return local_split( s, v, sep, false, true, num );
+  }
+
+  size_t split_exact_at_first_of( const string_view& s,
+				  vector<string_view>& v,
+				  const string_view& seps,
+				  size_t num ){
+    /// split a string at any of the characters in \e seps into views on its
+    /// parts, keeping empty parts. See split() for the parameters.
+    return local_split( s, v, seps, true, true, num );
+  }
+
+  StringSplitter::StringSplitter( const string_view& s,
+				  const string_view& seps,
+				  split_mode mode,
+				  bool exact ):
+    _src( s ),
+    _seps( seps ),
+    _first_of( mode == AT_FIRST_OF ),
+    _exact( exact )
+  {
+    /// create a lazy splitter on \e s
+    /*!
+      \param s the string to split. Is NOT copied, so it must outlive the
+      StringSplitter
+      \param seps the separator(s). Default whitespace. Is NOT copied either.
+      \param mode AT_FIRST_OF (the default) to split at any of the
+      characters in \e seps (like split_at_first_of()), or AT to split at
+      \e seps as a whole (like split_at())
+      \param exact when true, empty parts are kept (like split_exact())
+    */
+    if ( _seps.empty() ){
+      throw runtime_error( "TiCC::StringSplitter: separator is empty!" );
+    }
+  }
+
+  void StringSplitter::iterator::advance(){
+    /// move to the next part, skipping empty ones when needed
+    while ( _pos != string_view::npos ){
+      const StringSplitter& sp = *_splitter;
+      string_view::size_type e = find_sep( sp._src, sp._seps,
+					   sp._first_of, _pos );
+      if ( e == string_view::npos ){
+	_current = sp._src.substr( _pos );
+	_pos = e;
+      }
+      else {
+	_current = sp._src.substr( _pos, e - _pos );
+	_pos = e + ( sp._first_of ? 1 : sp._seps.length() );
+      }
+      if ( !_current.empty() || sp._exact ){
+	return;
+      }
+    }
+    _done = true;
+  }
+
+  /// @cond HIDDEN
+  template <class Strings>
+  static void local_join( string& out,
+			  const Strings& vec,
+			  const string_view& sep ){
+    // append the joined strings to out, with one (re)allocation at most
+    if ( vec.empty() ){
+      return;
+    }
+    size_t len = out.size() + sep.size() * ( vec.size() - 1 );
+    for ( const auto& s : vec ){
+      len += s.size();
+    }
+    out.reserve( len );
     for ( const auto& s : vec ){
-      result += s;
-      if ( &s != &vec.back() ){
-	result += sep;
+      if ( &s != &vec.front() ){
+	out += sep;
       }
+      out += s;
     }
+  }
+  /// @endcond
+
+  string join( const vector<string>& vec, const string& sep ){
+    string result;
+    local_join( result, vec, sep );
     return result;
   }
 
+  void join_into( string& out,
+		  const vector<string>& vec,
+		  const string& sep ){
+    /// join strings, separated by \e sep, into \e out
+    /*!
+      \param out the result. It is cleared first, but its buffer is reused,
+      so when it is big enough, nothing is allocated.
+      \param vec the strings to join
+      \param sep the separator. Default a space.
+    */
+    out.clear();
+    local_join( out, vec, sep );
+  }
+
+  void join_into( string& out,
+		  const vector<string_view>& vec,
+		  const string& sep ){
+    /// join string_views, separated by \e sep, into \e out
+    /*!
+      \param out the result. It is cleared first, but its buffer is reused.
+      \param vec the strings to join, e.g. the result of a split()
+      \param sep the separator. Default a space.
+    */
+    out.clear();
+    local_join( out, vec, sep );
+  }
+
   string format_non_printable( const string& s ){
     /// format weird strings (like UTF8, LATIN1) printable
     // useful for debugging
@@ -26,14 +26,63 @@
 */
 
 #include "ticcutils/UniHash.h"
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
 #include "ticcutils/Unicode.h"
+#include "ticcutils/FileUtils.h"
 // normalizer2.h is included via Unicode.h
+#include "unicode/utf8.h"
+#include "unicode/bytestream.h"
 
 using namespace std;
 using namespace icu;
 
 namespace Hash {
 
+  /// @cond HIDDEN
+  static const Normalizer2 *nfc_instance(){
+    // look the NFC normalizer up only once
+    static const Normalizer2 *nfc = [](){
+      UErrorCode status = U_ZERO_ERROR;
+      const Normalizer2 *n2 = Normalizer2::getNFCInstance(status);
+      return U_SUCCESS(status) ? n2 : nullptr;
+    }();
+    return nfc;
+  }
+
+  inline bool trivially_nfc( const UnicodeString& value ){
+    // all characters below U+0300 (the first combining mark) have
+    // NFC_Quick_Check=Yes and combining class 0. So a string with only
+    // those characters (e.g. ASCII) is always in NFC.
+    const UChar *p = value.getBuffer();
+    const UChar *end = p + value.length();
+    for ( ; p < end; ++p ){
+      if ( *p >= 0x300 ){
+	return false;
+      }
+    }
+    return true;
+  }
+
+  static const UnicodeString& nfc_normalized( const UnicodeString& value,
+					      UnicodeString& storage ){
+    // return value, or a NFC normalized copy of value in storage
+    // Optimization: Only normalize if strictly necessary
+    if ( trivially_nfc( value ) ){
+      return value;
+    }
+    const Normalizer2 *n2 = nfc_instance();
+    UErrorCode status = U_ZERO_ERROR;
+    if ( n2 && !n2->isNormalized(value, status) ){
+      n2->normalize(value, storage, status);
+      return storage;
+    }
+    return value;
+  }
+  /// @endcond
+
   UniInfo::UniInfo( const UnicodeString& value,
 		    const unsigned int index ):
     _value(value),_ID(index){
@@ -56,16 +105,123 @@ namespace Hash {
   }
 
   UnicodeHash::UnicodeHash():
-    _num_of_tokens(0) {
+    _num_of_tokens(0),
+    _arena_next(nullptr),
+    _arena_free(0) {
     /// initialize a new UnicodeHash
+    // index 0 is never used
+    _rev_index.push_back( UnicodeString() );
+    _table.resize( 16, slot{ 0, 0 } );
   }
 
   UnicodeHash::~UnicodeHash(){
     /// destroy a UnicodeHash
-    // We must explicitly delete the pointers stored in the map
-    for ( auto const& pair : _map ) {
-      delete pair.second;
+    // the arena blocks are released automaticly
+  }
+
+  UniView UnicodeHash::store( const UniView& value ){
+    /// copy the characters of \e value into the arena
+    /*!
+      \param value the characters to store
+      \return a view on the stored copy, valid during the lifetime of the
+      UnicodeHash
+    */
+    const size_t len = value.size();
+    UChar *dest;
+    if ( len > ARENA_BLOCK / 4 ){
+      // a long string gets a block of its own, so we don't waste the
+      // remainder of the current block
+      _arena.emplace_back( new UChar[len] );
+      dest = _arena.back().get();
+    }
+    else {
+      if ( len > _arena_free ){
+	_arena.emplace_back( new UChar[ARENA_BLOCK] );
+	_arena_next = _arena.back().get();
+	_arena_free = ARENA_BLOCK;
+      }
+      dest = _arena_next;
+      _arena_next += len;
+      _arena_free -= len;
     }
+    value.copy( dest, len );
+    return UniView( dest, len );
+  }
+
+  UniView UnicodeHash::view( unsigned int id ) const {
+    /// the characters of the string with ID \e id
+    const UnicodeString& s = _rev_index[id];
+    return UniView( s.getBuffer(), s.length() );
+  }
+
+  size_t UnicodeHash::find_slot( const UniView& key, size_t h ) const {
+    /// find the slot of a string in the table
+    /*!
+      \param key the string to find
+      \param h the hash value of \e key
+      \return the slot holding \e key, or the empty slot where it belongs
+    */
+    const size_t mask = _table.size() - 1;
+    const uint32_t h32 = static_cast<uint32_t>( h );
+    size_t pos = h & mask;
+    while ( _table[pos].id != 0 ){
+      if ( _table[pos].hash == h32 && view( _table[pos].id ) == key ){
+	break;
+      }
+      pos = ( pos + 1 ) & mask;
+    }
+    return pos;
+  }
+
+  void UnicodeHash::grow( size_t size ){
+    /// resize the table, so it can hold \e size entries
+    /*!
+      The table is kept at most 3/4 full, and its size is a power of two.
+      The slots keep the low bits of the hash values, so we don't have to
+      hash the strings again.
+    */
+    size_t new_size = _table.size();
+    while ( 3 * new_size < 4 * size ){
+      new_size *= 2;
+    }
+    if ( new_size == _table.size() ){
+      return;
+    }
+    vector<slot> table( new_size, slot{ 0, 0 } );
+    const size_t mask = new_size - 1;
+    for ( const auto& sl : _table ){
+      if ( sl.id != 0 ){
+	size_t pos = sl.hash & mask;
+	while ( table[pos].id != 0 ){
+	  pos = ( pos + 1 ) & mask;
+	}
+	table[pos] = sl;
+      }
+    }
+    _table.swap( table );
+  }
+
+  unsigned int UnicodeHash::insert( const UniView& key, size_t h,
+				    size_t pos ){
+    /// add a new string
+    /*!
+      \param key the string to add
+      \param h the hash value of \e key
+      \param pos the empty slot found for \e key by find_slot()
+      \return the new ID
+    */
+    if ( 4 * ( _num_of_tokens + 1 ) > 3 * _table.size() ){
+      grow( _num_of_tokens + 1 );
+      pos = find_slot( key, h );
+    }
+    UniView stored = store( key );
+    unsigned int idx = ++_num_of_tokens;
+    // a read-only alias on the arena, so reverse_lookup() can return a
+    // reference without copying anything.
+    _rev_index.emplace_back( false, stored.data(),
+			     static_cast<int32_t>(stored.size()) );
+    _table[pos] = slot{ idx, static_cast<uint32_t>( h ) };
+    return idx;
   }
 
   unsigned int UnicodeHash::hash( const UnicodeString& value ){
@@ -76,79 +232,672 @@ namespace Hash {
       when a new hash is inserted, the reverse index is also updated
       the UnicodeString will be NFC normalized first.
     */
-    UErrorCode status = U_ZERO_ERROR;
-    const Normalizer2 *n2 = Normalizer2::getNFCInstance(status);
-    const UnicodeString *pVal = &value;
     UnicodeString norm_storage;
+    const UnicodeString& val = nfc_normalized( value, norm_storage );
+    UniView key( val.getBuffer(), val.length() );
+    size_t h = UniViewHash()( key );
+    size_t pos = find_slot( key, h );
+    if ( _table[pos].id != 0 ){
+      return _table[pos].id;
+    }
+    // Not found, insert new
+    return insert( key, h, pos );
+  }
 
-    // Optimization: Only normalize if strictly necessary
-    if ( U_SUCCESS(status) && !n2->isNormalized(value, status) ){
-      n2->normalize(value, norm_storage, status);
-      pVal = &norm_storage;
+  unsigned int UnicodeHash::lookup( const UnicodeString& value ) const {
+    /// lookup the hash for a string in the UnicodeHash
+    /*!
+      \param value the string to lookup
+      \return the hash value, or 0 when not found
+    */
+    UnicodeString norm_storage;
+    const UnicodeString& val = nfc_normalized( value, norm_storage );
+    UniView key( val.getBuffer(), val.length() );
+    return _table[find_slot( key, UniViewHash()( key ) )].id;
+  }
+
+  void UnicodeHash::reserve( size_t size ){
+    /// make room for at least \e size entries, without rehashing
+    /*!
+      \param size the total number of entries expected
+    */
+    if ( 4 * size > 3 * _table.size() ){
+      grow( size );
     }
+  }
 
-    // Map lookup
-    auto it = _map.find( *pVal );
-    UniInfo *info = nullptr;
+  void UnicodeHash::hash_batch( const vector<UnicodeString>& values,
+				vector<unsigned int>& ids ){
+    /// lookup or create hashes for a whole batch of strings
+    /*!
+      \param values the strings to hash
+      \param ids the hash values, in the same order as \e values
 
-    if ( it == _map.end() ){
-      // Not found, insert new
-      info = new UniInfo( *pVal, ++_num_of_tokens );
-      _map.insert({ *pVal, info });
-    } else {
-      info = it->second;
+      Gives the same results as calling hash() for every value, but sizes
+      the hash only once for the whole batch.
+    */
+    ids.resize( values.size() );
+    reserve( _num_of_tokens + values.size() );
+    for ( size_t i=0; i < values.size(); ++i ){
+      ids[i] = hash( values[i] );
     }
+  }
 
-    unsigned int idx = info->index();
-    if ( idx >= _rev_index.size() ){
-      // Ensure capacity before resizing
-      if ( idx >= _rev_index.capacity() ) {
-           _rev_index.reserve( idx + 10000 );
+  void UnicodeHash::lookup_batch( const vector<UnicodeString>& values,
+				  vector<unsigned int>& ids ) const {
+    /// lookup the hashes for a whole batch of strings
+    /*!
+      \param values the strings to look up
+      \param ids the hash values (0 when not found), in the same order as
+      \e values
+    */
+    ids.resize( values.size() );
+    for ( size_t i=0; i < values.size(); ++i ){
+      ids[i] = lookup( values[i] );
+    }
+  }
+
+  const UnicodeString& UnicodeHash::reverse_lookup( unsigned int index ) const {
+    /// lookup the string value for a certain index
+    /*!
+      \param index the index we search
+      \return the string value
+
+      \note this assumes the index is valid, which isn't checked!
+    */
+    return _rev_index[index];
+  }
+
+  ostream& operator << ( ostream& os, const UnicodeHash& S ){
+    /// output the content of a whole UnicodeHash structure (Debugging only)
+    return os << "UnicodeHash map size: " << S._num_of_tokens;
+  }
+
+  /// @cond HIDDEN
+  //
+  // The snapshot format. All numbers are in native byte order.
+  //
+  //   snapshot_header
+  //   uint64_t offsets[num_entries+2]  string ID runs from offsets[ID] to
+  //                                    offsets[ID+1] in data
+  //   uint32_t table[table_size]       open addressing hash table with ID's,
+  //                                    0 is empty
+  //   (padding to a multiple of 8)
+  //   UChar data[data_length]          all strings, NFC normalized
+  //
+  struct snapshot_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint64_t num_entries;
+    uint64_t table_size;
+    uint64_t data_length;
+  };
+
+  static const char snapshot_magic[8] = { 'T','i','C','C','U','H','\0','\1' };
+  static const uint32_t snapshot_byte_order = 0x01020304;
+  static const uint32_t snapshot_version = 1;
+
+  inline uint64_t snapshot_hash( const UChar *s, size_t len ){
+    // FNV-1a. We can't use hashCode(), it may differ between ICU versions
+    uint64_t h = 14695981039346656037ULL;
+    for ( size_t i=0; i < len; ++i ){
+      h ^= s[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  inline size_t padding( size_t len ){
+    return (8 - len % 8) % 8;
+  }
+  /// @endcond
+
+  void UnicodeHash::save( const string& filename ) const {
+    /// save the UnicodeHash in a binary snapshot file
+    /*!
+      \param filename the file to create.
+      Will throw on failure.
+
+      The snapshot can be used by MappedUnicodeHash without any
+      deserialization, or be loaded again with load()
+    */
+    snapshot_header head;
+    memcpy( head.magic, snapshot_magic, sizeof(head.magic) );
+    head.byte_order = snapshot_byte_order;
+    head.version = snapshot_version;
+    head.num_entries = _num_of_tokens;
+    head.table_size = 8;
+    while ( head.table_size < 2 * head.num_entries ){
+      head.table_size <<= 1;
+    }
+    vector<uint64_t> offsets( head.num_entries + 2, 0 );
+    vector<uint32_t> table( head.table_size, 0 );
+    const uint64_t mask = head.table_size - 1;
+    uint64_t pos = 0;
+    for ( unsigned int id=1; id <= _num_of_tokens; ++id ){
+      UniView v = view( id );
+      offsets[id] = pos;
+      pos += v.size();
+      uint64_t slot = snapshot_hash( v.data(), v.size() ) & mask;
+      while ( table[slot] != 0 ){
+	slot = (slot + 1) & mask;
+      }
+      table[slot] = id;
+    }
+    offsets[head.num_entries+1] = pos;
+    head.data_length = pos;
+    ofstream os( filename, ios::binary );
+    if ( !os ){
+      throw runtime_error( "UnicodeHash::save(): unable to open '"
+			   + filename + "'" );
+    }
+    os.write( reinterpret_cast<const char*>(&head), sizeof(head) );
+    os.write( reinterpret_cast<const char*>(offsets.data()),
+	      offsets.size() * sizeof(uint64_t) );
+    size_t table_bytes = table.size() * sizeof(uint32_t);
+    os.write( reinterpret_cast<const char*>(table.data()), table_bytes );
+    const char zeros[8] = {0};
+    os.write( zeros, padding( table_bytes ) );
+    for ( unsigned int id=1; id <= _num_of_tokens; ++id ){
+      UniView v = view( id );
+      os.write( reinterpret_cast<const char*>(v.data()),
+		v.size() * sizeof(UChar) );
+    }
+    if ( !os ){
+      throw runtime_error( "UnicodeHash::save(): writing '"
+			   + filename + "' failed" );
+    }
+  }
+
+  void UnicodeHash::load( const string& filename ){
+    /// fill an empty UnicodeHash from a snapshot file created with save()
+    /*!
+      \param filename the snapshot to read.
+      Will throw on failure, or when the UnicodeHash isn't empty.
+      All strings will get the same ID as in the saved UnicodeHash.
+    */
+    if ( _num_of_tokens != 0 ){
+      throw logic_error( "UnicodeHash::load(): the hash is not empty" );
+    }
+    MappedUnicodeHash snapshot( filename );
+    reserve( snapshot.num_of_entries() );
+    for ( unsigned int id=1; id <= snapshot.num_of_entries(); ++id ){
+      UniView key = snapshot.reverse_view( id );
+      size_t h = UniViewHash()( key );
+      insert( key, h, find_slot( key, h ) );
+    }
+  }
+
+  MappedUnicodeHash::MappedUnicodeHash( const string& filename ):
+    _file( new TiCC::mapped_file( filename ) )
+  {
+    /// map a snapshot created by UnicodeHash::save() into memory
+    /*!
+      \param filename the snapshot file.
+      Will throw when the file is not a valid snapshot.
+    */
+    const char *base = _file->data();
+    const size_t size = _file->size();
+    snapshot_header head;
+    if ( size < sizeof(head) ){
+      throw runtime_error( "MappedUnicodeHash: '" + filename
+			   + "' is not a UnicodeHash snapshot" );
+    }
+    memcpy( &head, base, sizeof(head) );
+    if ( memcmp( head.magic, snapshot_magic, sizeof(head.magic) ) != 0 ){
+      throw runtime_error( "MappedUnicodeHash: '" + filename
+			   + "' is not a UnicodeHash snapshot" );
+    }
+    if ( head.byte_order != snapshot_byte_order ){
+      throw runtime_error( "MappedUnicodeHash: '" + filename
+			   + "' was created on a machine with another byte"
+			   " order" );
+    }
+    if ( head.version != snapshot_version ){
+      throw runtime_error( "MappedUnicodeHash: '" + filename
+			   + "' has an unsupported version: "
+			   + to_string( head.version ) );
+    }
+    // check the sizes, without overflowing on a corrupt header
+    size_t rest = size - sizeof(head);
+    bool ok = head.num_entries <= UINT32_MAX
+      && head.table_size > head.num_entries
+      && (head.table_size & (head.table_size - 1)) == 0
+      && head.num_entries + 2 <= rest / sizeof(uint64_t);
+    size_t offsets_bytes = 0;
+    size_t table_bytes = 0;
+    if ( ok ){
+      offsets_bytes = (head.num_entries + 2) * sizeof(uint64_t);
+      rest -= offsets_bytes;
+      ok = head.table_size <= rest / sizeof(uint32_t);
+    }
+    if ( ok ){
+      table_bytes = head.table_size * sizeof(uint32_t);
+      rest -= table_bytes;
+      ok = padding( table_bytes ) <= rest
+	&& head.data_length == ( rest - padding( table_bytes ) ) / sizeof(UChar)
+	&& ( rest - padding( table_bytes ) ) % sizeof(UChar) == 0;
+    }
+    if ( ok ){
+      // the strings must lie within the data, in order
+      const uint64_t *offsets
+	= reinterpret_cast<const uint64_t*>( base + sizeof(head) );
+      for ( uint64_t id=0; ok && id <= head.num_entries; ++id ){
+	ok = offsets[id] <= offsets[id+1];
+      }
+      ok = ok && offsets[head.num_entries+1] <= head.data_length;
+    }
+    if ( ok ){
+      // all ID's in the table must exist, and there must be an empty slot,
+      // otherwise lookup() would never end
+      const uint32_t *table = reinterpret_cast<const uint32_t*>
+	( base + sizeof(head) + offsets_bytes );
+      bool has_empty = false;
+      for ( uint64_t slot=0; ok && slot < head.table_size; ++slot ){
+	if ( table[slot] == 0 ){
+	  has_empty = true;
+	}
+	else {
+	  ok = table[slot] <= head.num_entries;
+	}
       }
-      _rev_index.resize( idx + 1000, nullptr );
+      ok = ok && has_empty;
+    }
+    if ( !ok ){
+      throw runtime_error( "MappedUnicodeHash: '" + filename
+			   + "' is corrupt" );
     }
-    _rev_index[idx] = info;
+    _num_of_tokens = head.num_entries;
+    _offsets = reinterpret_cast<const uint64_t*>( base + sizeof(head) );
+    _table = reinterpret_cast<const uint32_t*>( base + sizeof(head)
+						+ offsets_bytes );
+    _table_mask = head.table_size - 1;
+    _data = reinterpret_cast<const UChar*>( base + sizeof(head)
+					    + offsets_bytes + table_bytes
+					    + padding( table_bytes ) );
+  }
+
+  MappedUnicodeHash::~MappedUnicodeHash(){
+    /// destroy a MappedUnicodeHash, unmapping the file
+  }
+
+  unsigned int MappedUnicodeHash::lookup( const UnicodeString& value ) const {
+    /// lookup the hash for a string in the MappedUnicodeHash
+    /*!
+      \param value the string to lookup
+      \return the hash value, or 0 when not found
+    */
+    UnicodeString norm_storage;
+    const UnicodeString& val = nfc_normalized( value, norm_storage );
+    const UChar *chars = val.getBuffer();
+    const uint64_t len = val.length();
+    uint64_t slot = snapshot_hash( chars, len ) & _table_mask;
+    while ( _table[slot] != 0 ){
+      const uint32_t id = _table[slot];
+      const uint64_t start = _offsets[id];
+      if ( _offsets[id+1] - start == len
+	   && ( len == 0
+		|| memcmp( _data + start, chars, len * sizeof(UChar) ) == 0 ) ){
+	return id;
+      }
+      slot = (slot + 1) & _table_mask;
+    }
+    return 0;
+  }
+
+  UnicodeString MappedUnicodeHash::reverse_lookup( unsigned int index ) const {
+    /// lookup the string value for a certain index
+    /*!
+      \param index the index we search
+      \return a copy of the string value. Use reverse_view() to avoid the
+      copy
+
+      \note this assumes the index is valid, which isn't checked!
+    */
+    const UniView v = reverse_view( index );
+    return UnicodeString( v.data(), static_cast<int32_t>(v.size()) );
+  }
+
+  UniView MappedUnicodeHash::reverse_view( unsigned int index ) const {
+    /// lookup the string value for a certain index, without copying
+    /*!
+      \param index the index we search
+      \return a view into the mapped file, valid as long as the
+      MappedUnicodeHash exists
+
+      \note this assumes the index is valid, which isn't checked!
+    */
+    const uint64_t start = _offsets[index];
+    return UniView( _data + start, _offsets[index+1] - start );
+  }
+
+  ostream& operator << ( ostream& os, const MappedUnicodeHash& S ){
+    /// output the content of a whole MappedUnicodeHash structure
+    /// (Debugging only)
+    return os << "MappedUnicodeHash " << S._file->name() << " size: "
+	      << S.num_of_entries();
+  }
+
+  ConcurrentUnicodeHash::ConcurrentUnicodeHash( unsigned int num_shards ):
+    _num_of_tokens(0) {
+    /// initialize a new ConcurrentUnicodeHash
+    /*!
+      \param num_shards the number of independently locked parts of the
+      table. Will be rounded up to a power of 2. Default 64
+    */
+    unsigned int size = 1;
+    while ( size < num_shards ){
+      size <<= 1;
+    }
+    _shards.reset( new shard[size] );
+    _shard_mask = size - 1;
+    for ( auto& seg : _segments ){
+      seg.store( nullptr );
+    }
+  }
+
+  ConcurrentUnicodeHash::~ConcurrentUnicodeHash(){
+    /// destroy a ConcurrentUnicodeHash
+    for ( auto& seg : _segments ){
+      delete [] seg.load();
+    }
+  }
+
+  ConcurrentUnicodeHash::shard&
+  ConcurrentUnicodeHash::select_shard( const UnicodeString& value ) const {
+    /// find the shard which holds \e value
+    // spread the hashCode, so the shard and the buckets inside the shard
+    // don't depend on the same bits
+    uint32_t h = static_cast<uint32_t>(value.hashCode()) * 0x9E3779B1u;
+    return _shards[ (h >> 16) & _shard_mask ];
+  }
+
+  /// @cond HIDDEN
+  inline void segment_of( unsigned int index, const int base,
+			  int& seg, uint64_t& offset ){
+    // segment s holds 2^(s+base) entries, starting at ID 2^(s+base) - 2^base
+    uint64_t j = static_cast<uint64_t>(index) + (uint64_t(1) << base);
+    int bit = 63 - __builtin_clzll( j );
+    seg = bit - base;
+    offset = j - (uint64_t(1) << bit);
+  }
+  /// @endcond
+
+  std::atomic<const UnicodeString*>&
+  ConcurrentUnicodeHash::rev_slot( unsigned int index ){
+    /// return the reverse index entry for \e index, allocating its
+    /// segment when needed
+    int seg;
+    uint64_t offset;
+    segment_of( index, SEG_BITS, seg, offset );
+    atomic<const UnicodeString*> *segment
+      = _segments[seg].load( memory_order_acquire );
+    if ( segment == nullptr ){
+      // only the insert path comes here, and only for a fresh segment
+      lock_guard<mutex> guard( _segment_lock );
+      segment = _segments[seg].load( memory_order_acquire );
+      if ( segment == nullptr ){
+	size_t seg_size = size_t(1) << (seg + SEG_BITS);
+	segment = new atomic<const UnicodeString*>[seg_size];
+	for ( size_t i=0; i < seg_size; ++i ){
+	  segment[i].store( nullptr, memory_order_relaxed );
+	}
+	_segments[seg].store( segment, memory_order_release );
+      }
+    }
+    return segment[offset];
+  }
+
+  const std::atomic<const UnicodeString*>&
+  ConcurrentUnicodeHash::rev_slot( unsigned int index ) const {
+    /// return the reverse index entry for \e index. The segment must exist.
+    int seg;
+    uint64_t offset;
+    segment_of( index, SEG_BITS, seg, offset );
+    return _segments[seg].load( memory_order_acquire )[offset];
+  }
+
+  unsigned int ConcurrentUnicodeHash::hash( const UnicodeString& value ){
+    /// lookup or create a hash for the string parameter
+    /*!
+      \param value the string to hash
+      \return the hash value
+      when a new hash is inserted, the reverse index is also updated
+      the UnicodeString will be NFC normalized first.
+
+      Safe to call from multiple threads.
+    */
+    UnicodeString norm_storage;
+    const UnicodeString& val = nfc_normalized( value, norm_storage );
+    shard& sh = select_shard( val );
+    {
+      shared_lock<shared_mutex> read_guard( sh.lock );
+      auto it = sh.map.find( val );
+      if ( it != sh.map.end() ){
+	return it->second;
+      }
+    }
+    unique_lock<shared_mutex> write_guard( sh.lock );
+    // another thread might have been faster
+    auto it = sh.map.find( val );
+    if ( it != sh.map.end() ){
+      return it->second;
+    }
+    // the ID is only taken when we really insert, which keeps them dense
+    unsigned int idx = _num_of_tokens.fetch_add( 1, memory_order_acq_rel ) + 1;
+    auto ins = sh.map.insert( { val, idx } );
+    // the keys of an unordered_map never move, so we may point to them
+    rev_slot( idx ).store( &ins.first->first, memory_order_release );
     return idx;
   }
 
-  unsigned int UnicodeHash::lookup( const UnicodeString& value ) const {
-    /// lookup the hash for a string in the UnicodeHash
+  unsigned int ConcurrentUnicodeHash::lookup( const UnicodeString& value ) const {
+    /// lookup the hash for a string in the ConcurrentUnicodeHash
     /*!
       \param value the string to lookup
       \return the hash value, or 0 when not found
     */
+    UnicodeString norm_storage;
+    const UnicodeString& val = nfc_normalized( value, norm_storage );
+    const shard& sh = select_shard( val );
+    shared_lock<shared_mutex> read_guard( sh.lock );
+    auto it = sh.map.find( val );
+    if ( it != sh.map.end() ){
+      return it->second;
+    }
+    return 0;
+  }
+
+  const UnicodeString& ConcurrentUnicodeHash::reverse_lookup( unsigned int index ) const {
+    /// lookup the string value for a certain index
+    /*!
+      \param index the index we search
+      \return the string value
+
+      \note this assumes the index is valid, which isn't checked!
+      Valid means: returned by a hash() call which has finished.
+    */
+    return *rev_slot( index ).load( memory_order_acquire );
+  }
+
+  ostream& operator << ( ostream& os, const ConcurrentUnicodeHash& S ){
+    /// output the content of a whole ConcurrentUnicodeHash structure
+    /// (Debugging only)
+    return os << "ConcurrentUnicodeHash size: " << S.num_of_entries()
+	      << " in " << S._shard_mask + 1 << " shards";
+  }
+
+  /// @cond HIDDEN
+  enum utf8_kind { UTF8_SIMPLE, UTF8_OTHER, UTF8_INVALID };
+
+  static utf8_kind classify_utf8( const string_view& value ){
+    // find out if value is valid UTF-8, and if it only contains characters
+    // below U+0300 (so it is in NFC, see trivially_nfc())
+    const uint8_t *s = reinterpret_cast<const uint8_t*>( value.data() );
+    const int32_t len = static_cast<int32_t>( value.size() );
+    utf8_kind result = UTF8_SIMPLE;
+    int32_t i = 0;
+    while ( i < len ){
+      if ( s[i] < 0x80 ){
+	// ASCII, the common case
+	++i;
+	continue;
+      }
+      UChar32 c;
+      U8_NEXT( s, i, len, c );
+      if ( c < 0 ){
+	return UTF8_INVALID;
+      }
+      if ( c >= 0x300 ){
+	result = UTF8_OTHER;
+      }
+    }
+    return result;
+  }
+
+  static string_view nfc_normalized( const string_view& value,
+				     string& storage ){
+    // return value, or a NFC normalized (and valid) copy of value in storage
+    utf8_kind kind = classify_utf8( value );
+    if ( kind == UTF8_SIMPLE ){
+      return value;
+    }
+    const Normalizer2 *n2 = nfc_instance();
+    if ( !n2 ){
+      return value;
+    }
     UErrorCode status = U_ZERO_ERROR;
-    const Normalizer2 *n2 = Normalizer2::getNFCInstance(status);
-    const UnicodeString *pVal = &value;
+#if U_ICU_VERSION_MAJOR_NUM >= 60
+    if ( kind == UTF8_OTHER ){
+      // valid UTF-8, so we can let ICU work on the bytes directly
+      StringPiece piece( value.data(), static_cast<int32_t>(value.size()) );
+      if ( n2->isNormalizedUTF8( piece, status ) || U_FAILURE(status) ){
+	return value;
+      }
+      storage.clear();
+      StringByteSink<string> sink( &storage );
+      status = U_ZERO_ERROR;
+      n2->normalizeUTF8( 0, piece, sink, nullptr, status );
+      return U_SUCCESS(status) ? string_view( storage ) : value;
+    }
+#endif
+    // take the slow road through UTF-16. This also replaces invalid bytes
+    StringPiece piece( value.data(), static_cast<int32_t>(value.size()) );
+    UnicodeString us = UnicodeString::fromUTF8( piece );
     UnicodeString norm_storage;
+    const UnicodeString& norm = nfc_normalized( us, norm_storage );
+    storage.clear();
+    norm.toUTF8String( storage );
+    return storage;
+  }
+  /// @endcond
 
-    // Optimization: Only normalize if strictly necessary
-    if ( U_SUCCESS(status) && !n2->isNormalized(value, status) ){
-      n2->normalize(value, norm_storage, status);
-      pVal = &norm_storage;
+  UTF8Hash::UTF8Hash():
+    _num_of_tokens(0),
+    _arena_next(nullptr),
+    _arena_free(0) {
+    /// initialize a new UTF8Hash
+    _rev_index.push_back( string_view() ); // index 0 is never used
+  }
+
+  UTF8Hash::~UTF8Hash(){
+    /// destroy a UTF8Hash
+    // the arena blocks are released automaticly
+  }
+
+  string_view UTF8Hash::store( const string_view& value ){
+    /// copy the bytes of \e value into the arena
+    /*!
+      \param value the bytes to store
+      \return a view on the stored copy, valid during the lifetime of the
+      UTF8Hash
+    */
+    const size_t len = value.size();
+    char *dest;
+    if ( len > ARENA_BLOCK / 4 ){
+      // a long string gets a block of its own
+      _arena.emplace_back( new char[len] );
+      dest = _arena.back().get();
+    }
+    else {
+      if ( len > _arena_free ){
+	_arena.emplace_back( new char[ARENA_BLOCK] );
+	_arena_next = _arena.back().get();
+	_arena_free = ARENA_BLOCK;
+      }
+      dest = _arena_next;
+      _arena_next += len;
+      _arena_free -= len;
     }
+    value.copy( dest, len );
+    return string_view( dest, len );
+  }
+
+  unsigned int UTF8Hash::hash( const string_view& value ){
+    /// lookup or create a hash for the UTF-8 string parameter
+    /*!
+      \param value the UTF-8 string to hash
+      \return the hash value
+      when a new hash is inserted, the reverse index is also updated
+      the string will be NFC normalized first.
+    */
+    string norm_storage;
+    string_view key = nfc_normalized( value, norm_storage );
+    auto it = _map.find( key );
+    if ( it != _map.end() ){
+      return it->second;
+    }
+    // Not found, insert new
+    string_view stored = store( key );
+    unsigned int idx = ++_num_of_tokens;
+    _map.emplace( stored, idx );
+    _rev_index.push_back( stored );
+    return idx;
+  }
 
-    auto it = _map.find( *pVal );
+  unsigned int UTF8Hash::lookup( const string_view& value ) const {
+    /// lookup the hash for a UTF-8 string in the UTF8Hash
+    /*!
+      \param value the string to lookup
+      \return the hash value, or 0 when not found
+    */
+    string norm_storage;
+    auto it = _map.find( nfc_normalized( value, norm_storage ) );
     if ( it != _map.end() ){
-      return it->second->index();
+      return it->second;
     }
     return 0;
   }
 
-  const UnicodeString& UnicodeHash::reverse_lookup( unsigned int index ) const {
-    /// lookup the string value for a certain index
+  void UTF8Hash::reserve( size_t size ){
+    /// make room for at least \e size entries, without rehashing
+    /*!
+      \param size the total number of entries expected
+    */
+    if ( size + 1 > _rev_index.capacity() ){
+      _rev_index.reserve( max( size + 1, 2 * _rev_index.capacity() ) );
+    }
+    if ( size > _map.bucket_count() * _map.max_load_factor() ){
+      _map.reserve( max( size, 2 * _map.size() ) );
+    }
+  }
+
+  string_view UTF8Hash::reverse_lookup( unsigned int index ) const {
+    /// lookup the UTF-8 string value for a certain index
     /*!
       \param index the index we search
-      \return the string value
+      \return a view on the string value, valid as long as the UTF8Hash
+      exists.
 
       \note this assumes the index is valid, which isn't checked!
     */
-    return _rev_index[index]->value();
+    return _rev_index[index];
   }
 
-  ostream& operator << ( ostream& os, const UnicodeHash& S ){
-    /// output the content of a whole UnicodeHash structure (Debugging only)
-    return os << "UnicodeHash map size: " << S._map.size();
+  ostream& operator << ( ostream& os, const UTF8Hash& S ){
+    /// output the content of a whole UTF8Hash structure (Debugging only)
+    return os << "UTF8Hash map size: " << S._map.size();
   }
 
 }
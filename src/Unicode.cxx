@@ -30,9 +30,18 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 #include "unicode/parseerr.h"
 #include "unicode/utrans.h"
 #include "unicode/utypes.h"
+#include "unicode/ustring.h"
+#include "unicode/utf8.h"
 #include "ticcutils/StringOps.h"
 
 using namespace std;
@@ -40,6 +49,109 @@ using namespace std;
 namespace TiCC {
   using namespace icu;
 
+  /// @cond HIDDEN
+  namespace {
+  UnicodeNormalizer& cached_normalizer( const string& mode ){
+    // return a normalizer for this thread, set to mode
+    // setMode() is a no-op when the mode doesn't change, which is the
+    // normal case
+    thread_local UnicodeNormalizer normalizer;
+    normalizer.setMode( mode );
+    return normalizer;
+  }
+
+  struct converter_closer {
+    void operator()( UConverter *conv ) const { ucnv_close( conv ); }
+  };
+
+  UConverter *cached_converter( const string& encoding ){
+    // return a converter for this thread, or NULL for an unknown encoding
+    thread_local map<string,unique_ptr<UConverter,converter_closer>> cache;
+    auto it = cache.find( encoding );
+    if ( it != cache.end() ){
+      return it->second.get();
+    }
+    UErrorCode err = U_ZERO_ERROR;
+    UConverter *conv = ucnv_open( encoding.c_str(), &err );
+    if ( U_FAILURE(err) ){
+      return 0;
+    }
+    cache[encoding].reset( conv );
+    return conv;
+  }
+
+  bool is_utf8_name( const string& encoding ){
+    return ucnv_compareNames( encoding.c_str(), "UTF8" ) == 0;
+  }
+
+  bool is_ascii( const char *s, size_t len ){
+    size_t i = 0;
+    for ( ; i + 8 <= len; i += 8 ){
+      uint64_t chunk;
+      memcpy( &chunk, s + i, 8 );
+      if ( chunk & 0x8080808080808080ULL ){
+	return false;
+      }
+    }
+    for ( ; i < len; ++i ){
+      if ( static_cast<unsigned char>( s[i] ) >= 0x80 ){
+	return false;
+      }
+    }
+    return true;
+  }
+
+  bool convert_to_unicode( UConverter *conv,
+			   const char *s,
+			   size_t len,
+			   UnicodeString& us ){
+    // convert len chars from s into us, reusing the buffer of us.
+    // When conv is NULL, s is UTF-8.
+    // returns true when s was plain ASCII, which needs no normalization
+    if ( conv == 0
+	 && is_ascii( s, len ) ){
+      // just widen it
+      UChar *buf = us.getBuffer( static_cast<int32_t>( len ) );
+      for ( size_t i=0; i < len; ++i ){
+	buf[i] = static_cast<UChar>( s[i] );
+      }
+      us.releaseBuffer( static_cast<int32_t>( len ) );
+      return true;
+    }
+    // for the encodings that make sense here, the number of UTF-16 code
+    // units never exceeds the number of bytes. But just in case...
+    int32_t capacity = static_cast<int32_t>( len ) + 1;
+    for ( int tries=0; tries < 2; ++tries ){
+      UErrorCode err = U_ZERO_ERROR;
+      UChar *buf = us.getBuffer( capacity );
+      int32_t out_len = 0;
+      if ( conv == 0 ){
+	u_strFromUTF8WithSub( buf, us.getCapacity(), &out_len,
+			      s, static_cast<int32_t>( len ),
+			      0xFFFD, NULL, &err );
+      }
+      else {
+	ucnv_resetToUnicode( conv );
+	out_len = ucnv_toUChars( conv, buf, us.getCapacity(),
+				 s, static_cast<int32_t>( len ), &err );
+      }
+      if ( err == U_BUFFER_OVERFLOW_ERROR ){
+	us.releaseBuffer( 0 );
+	capacity = out_len + 1;
+	continue;
+      }
+      us.releaseBuffer( U_SUCCESS(err) ? out_len : 0 );
+      if ( U_FAILURE(err) ){
+	throw runtime_error( string( "Unicode conversion failed: " )
+			     + u_errorName( err ) );
+      }
+      break;
+    }
+    return false;
+  }
+  }
+  /// @endcond
+
   UnicodeString UnicodeFromEnc( const string& s,
 				const string& encoding,
 				const string& normalization ){
@@ -50,11 +162,28 @@ namespace TiCC {
       \param normalization the normalization to use. Default NFC
       \return a normalized UnicodeString object
     */
-    UnicodeString result = UnicodeString( s.c_str(),
-					  s.length(),
-					  encoding.c_str() );
-    UnicodeNormalizer UN( normalization);
-    return UN.normalize( result );
+    UnicodeNormalizer& UN = cached_normalizer( normalization );
+    UnicodeString result;
+    if ( is_utf8_name( encoding ) ){
+      if ( convert_to_unicode( 0, s.data(), s.length(), result ) ){
+	return result;
+      }
+    }
+    else {
+      UConverter *conv = 0;
+      if ( !encoding.empty() ){
+	conv = cached_converter( encoding );
+      }
+      if ( conv == 0 ){
+	// let ICU decide what to do
+	result = UnicodeString( s.c_str(), s.length(), encoding.c_str() );
+      }
+      else {
+	convert_to_unicode( conv, s.data(), s.length(), result );
+      }
+    }
+    UN.normalize_inplace( result );
+    return result;
   }
 
   string UnicodeToUTF8( const UnicodeString& s,
@@ -65,18 +194,44 @@ namespace TiCC {
       \param normalization the normalization to use. Default NFC
       \return an UTF-8 encoded string
     */
-    UnicodeNormalizer UN( normalization);
-    UnicodeString normalized = UN.normalize( s );
+    UnicodeNormalizer& UN = cached_normalizer( normalization );
     string result;
+    const UChar *buf = s.getBuffer();
+    int32_t len = s.length();
+    if ( buf ){
+      int32_t i = 0;
+      while ( i < len && buf[i] < 0x80 ){
+	++i;
+      }
+      if ( i == len ){
+	// plain ASCII, which is the same in every normalization
+	result.resize( len );
+	for ( i=0; i < len; ++i ){
+	  result[i] = static_cast<char>( buf[i] );
+	}
+	return result;
+      }
+    }
+    UnicodeString normalized = s;
+    UN.normalize_inplace( normalized );
     normalized.toUTF8String(result);
     return result;
   }
 
   UnicodeString UnicodeFromUTF8( const string& s,
 				 const string& normalization ){
-    UnicodeNormalizer UN( normalization);
-    UnicodeString result = UnicodeString::fromUTF8( s );
-    return UN.normalize( result );
+    /// convert an UTF-8 string to a UnicodeString
+    /*!
+      \param s the UTF-8 encoded string
+      \param normalization the normalization to use. Default NFC
+      \return a normalized UnicodeString object
+    */
+    UnicodeNormalizer& UN = cached_normalizer( normalization );
+    UnicodeString result;
+    if ( !convert_to_unicode( 0, s.data(), s.length(), result ) ){
+      UN.normalize_inplace( result );
+    }
+    return result;
   }
 
   UnicodeNormalizer::UnicodeNormalizer( const string& enc ): _normalizer(0) {
@@ -144,16 +299,202 @@ namespace TiCC {
       \param us the UnicodeString to normalize
       \return the UnicodeString in the correct normalization
     */
+    // copying is cheap, the buffer is shared until one of them changes.
+    // mostly, us is already normalized, and this copy is all we do
+    UnicodeString r = us;
+    normalize_inplace( r );
+    return r;
+  }
+
+  void UnicodeNormalizer::normalize_inplace( UnicodeString& us ){
+    /// normalize a UnicodeString to the current mode
+    /*!
+      \param us the UnicodeString to normalize. It is only modified when
+      it is not yet in the correct normalization
+    */
     if ( _normalizer == 0 ){
-      return us;
+      return;
+    }
+    UErrorCode status = U_ZERO_ERROR;
+    // the part that is already normalized, according to a quick check
+    int32_t span = _normalizer->spanQuickCheckYes( us, status );
+    if ( U_FAILURE(status) ){
+      throw invalid_argument("Normalizer");
+    }
+    if ( span == us.length() ){
+      return;
+    }
+    UnicodeString result( us, 0, span );
+    _normalizer->normalizeSecondAndAppend( result,
+					   us.tempSubString( span ),
+					   status );
+    if ( U_FAILURE(status) ){
+      throw invalid_argument("Normalizer");
+    }
+    us.swap( result );
+  }
+
+  /// @cond HIDDEN
+  namespace {
+  const size_t NORMALIZE_CHUNK = 1024*1024;
+  const size_t NORMALIZE_BATCH = 16;
+
+  size_t safe_split( const Normalizer2 *normalizer,
+		     const char *s,
+		     size_t len ){
+    // find the last position in the UTF-8 buffer s where we may split
+    // without changing the normalization: before a complete character
+    // that has a normalization boundary before it.
+    // returns 0 when there is no such position
+    int32_t i = static_cast<int32_t>( len );
+    const uint8_t *us = reinterpret_cast<const uint8_t*>( s );
+    while ( i > 0 ){
+      UChar32 c;
+      U8_PREV( us, 0, i, c );
+      if ( i > 0
+	   && c >= 0
+	   && ( normalizer == 0
+		|| normalizer->hasBoundaryBefore( c ) ) ){
+	return i;
+      }
+    }
+    return 0;
+  }
+
+  void normalize_chunk( UnicodeNormalizer& normalizer,
+			const char *s,
+			size_t len,
+			string& out ){
+    // normalize len bytes of UTF-8 and append them to out
+    UnicodeString us;
+    convert_to_unicode( 0, s, len, us );
+    normalizer.normalize_inplace( us );
+    us.toUTF8String( out );
+  }
+
+  void split_chunks( const Normalizer2 *normalizer,
+		     string& buffer,
+		     bool at_end,
+		     vector<string>& chunks ){
+    // cut buffer into chunks of about NORMALIZE_CHUNK bytes, which can be
+    // normalized independently. What can't be split safely yet, stays
+    // in buffer, unless we are at_end
+    size_t pos = 0;
+    while ( buffer.size() - pos >= NORMALIZE_CHUNK ){
+      size_t split = safe_split( normalizer,
+				 buffer.data() + pos, NORMALIZE_CHUNK );
+      if ( split == 0 ){
+	// a very long combining sequence. Just take more
+	split = safe_split( normalizer,
+			    buffer.data() + pos, buffer.size() - pos );
+	if ( split == 0 ){
+	  break;
+	}
+      }
+      chunks.push_back( buffer.substr( pos, split ) );
+      pos += split;
+    }
+    if ( at_end ){
+      if ( pos < buffer.size() ){
+	chunks.push_back( buffer.substr( pos ) );
+      }
+      buffer.clear();
     }
     else {
-      UErrorCode status=U_ZERO_ERROR;
-      UnicodeString r = _normalizer->normalize( us, status );
-      if (U_FAILURE(status)){
-	throw invalid_argument("Normalizer");
+      buffer.erase( 0, pos );
+    }
+  }
+  }
+  /// @endcond
+
+  void UnicodeNormalizer::normalize( const string& in, string& out ){
+    /// normalize an UTF-8 encoded buffer to the current mode
+    /*!
+      \param in the UTF-8 buffer to normalize
+      \param out the string to append the normalized UTF-8 to
+
+      The result is the same as UnicodeToUTF8( normalize( UnicodeFromUTF8(
+      in ) ) ), but the buffer is processed in chunks, to keep the UTF-16
+      copy small.
+    */
+    size_t pos = 0;
+    while ( pos < in.size() ){
+      size_t len = in.size() - pos;
+      if ( len > NORMALIZE_CHUNK ){
+	size_t split = safe_split( _normalizer, in.data() + pos,
+				   NORMALIZE_CHUNK );
+	if ( split == 0 ){
+	  split = safe_split( _normalizer, in.data() + pos, len );
+	}
+	if ( split > 0 ){
+	  len = split;
+	}
       }
-      return r;
+      normalize_chunk( *this, in.data() + pos, len, out );
+      pos += len;
+    }
+  }
+
+  void UnicodeNormalizer::normalize( istream& is, ostream& os ){
+    /// normalize an UTF-8 encoded stream to the current mode
+    /*!
+      \param is the stream to read from
+      \param os the stream to write the normalized UTF-8 to
+
+      The input is read and normalized in chunks, split at normalization
+      boundaries.
+    */
+    string buffer;
+    vector<char> block( NORMALIZE_CHUNK );
+    vector<string> chunks;
+    string out;
+    while ( is ){
+      is.read( block.data(), block.size() );
+      buffer.append( block.data(), is.gcount() );
+      split_chunks( _normalizer, buffer, !is, chunks );
+      for ( const auto& chunk : chunks ){
+	out.clear();
+	normalize_chunk( *this, chunk.data(), chunk.size(), out );
+	os << out;
+      }
+      chunks.clear();
+    }
+  }
+
+  void UnicodeNormalizer::normalize_parallel( istream& is, ostream& os ){
+    /// normalize an UTF-8 encoded stream to the current mode, in parallel
+    /*!
+      \param is the stream to read from
+      \param os the stream to write the normalized UTF-8 to
+
+      Like normalize( istream&, ostream& ), but batches of chunks are
+      normalized by several OpenMP threads. The output is in input order.
+    */
+    string buffer;
+    vector<char> block( NORMALIZE_CHUNK );
+    vector<string> chunks;
+    vector<string> results;
+    while ( is ){
+      while ( is && chunks.size() < NORMALIZE_BATCH ){
+	is.read( block.data(), block.size() );
+	buffer.append( block.data(), is.gcount() );
+	split_chunks( _normalizer, buffer, !is, chunks );
+      }
+      results.resize( chunks.size() );
+      const string mode = _mode;
+#pragma omp parallel for schedule(dynamic,1)
+      for ( size_t i=0; i < chunks.size(); ++i ){
+	// the UnicodeNormalizer is cheap, and only holds a pointer to the
+	// shared (and thread safe) ICU Normalizer2
+	UnicodeNormalizer un( mode );
+	results[i].clear();
+	normalize_chunk( un, chunks[i].data(), chunks[i].size(), results[i] );
+      }
+      for ( const auto& result : results ){
+	os << result;
+      }
+      chunks.clear();
+      results.clear();
     }
   }
 
@@ -170,6 +511,44 @@ namespace TiCC {
     return _pattern->pattern();
   }
 
+  /// @cond HIDDEN
+  class UnicodeRegexMatcher::matcher_lease {
+    // borrow a RegexMatcher from the pool, for as long as we live
+  public:
+    explicit matcher_lease( const UnicodeRegexMatcher& owner ):
+      _owner( owner ),
+      _matcher( 0 )
+    {
+      {
+	lock_guard<mutex> lock( _owner._pool_lock );
+	if ( !_owner._pool.empty() ){
+	  _matcher = _owner._pool.back();
+	  _owner._pool.pop_back();
+	  return;
+	}
+      }
+      UErrorCode u_stat = U_ZERO_ERROR;
+      _matcher = _owner._pattern->matcher( u_stat );
+      if ( U_FAILURE(u_stat) ){
+	delete _matcher;
+	string failString = "'" + UnicodeToUTF8(_owner.Pattern()) + "'";
+	throw uRegexError(failString);
+      }
+    }
+    ~matcher_lease(){
+      lock_guard<mutex> lock( _owner._pool_lock );
+      _owner._pool.push_back( _matcher );
+    }
+    RegexMatcher *operator->() const { return _matcher; };
+    RegexMatcher *get() const { return _matcher; };
+  private:
+    matcher_lease( const matcher_lease& ) = delete;
+    matcher_lease& operator=( const matcher_lease& ) = delete;
+    const UnicodeRegexMatcher& _owner;
+    RegexMatcher *_matcher;
+  };
+  /// @endcond
+
   UnicodeRegexMatcher::UnicodeRegexMatcher( const UnicodeString& pat,
 					    const UnicodeString& name ):
     _name(name), _debug(false)
@@ -179,7 +558,6 @@ namespace TiCC {
       \param pat The pattern to use
       \param name a name we give to this RegexMatcher (for error messages)
     */
-    _matcher = NULL;
     UErrorCode u_stat = U_ZERO_ERROR;
     UParseError errorInfo;
     _pattern = RegexPattern::compile( pat, 0, errorInfo, u_stat );
@@ -197,20 +575,109 @@ namespace TiCC {
       throw uRegexError(failString);
     }
     else {
-      _matcher = _pattern->matcher( u_stat );
-      if (U_FAILURE(u_stat)){
-	string failString = "'" + UnicodeToUTF8(pat) + "'";
-	throw uRegexError(failString);
+      // create the first matcher now, so problems show up here
+      try {
+	matcher_lease first( *this );
+      }
+      catch ( ... ){
+	delete _pattern;
+	throw;
       }
     }
   }
 
   UnicodeRegexMatcher::~UnicodeRegexMatcher(){
     /// destroy a RegexMatcher
+    for ( const auto& matcher : _pool ){
+      delete matcher;
+    }
     delete _pattern;
-    delete _matcher;
   }
 
+  /// @cond HIDDEN
+  namespace {
+  bool match_spans( RegexMatcher *matcher,
+		    const UnicodeString& line,
+		    bool debug,
+		    vector<UnicodeRegexMatcher::span>& results,
+		    UnicodeRegexMatcher::span& pre,
+		    UnicodeRegexMatcher::span& post ){
+    // the work horse for match_all() and match_offsets()
+    typedef UnicodeRegexMatcher::span span;
+    UErrorCode u_stat = U_ZERO_ERROR;
+    results.clear();
+    pre = span( 0, 0 );
+    post = span( line.length(), line.length() );
+    matcher->reset( line );
+    if ( !matcher->find() ){
+      return false;
+    }
+    if ( debug ){
+      cerr << "matched " << line << endl;
+      for ( int i=0; i <= matcher->groupCount(); ++i ){
+	cerr << "group[" << i << "] =" << matcher->group(i,u_stat) << endl;
+      }
+    }
+    int groups = matcher->groupCount();
+    if ( groups == 0
+	 || ( groups == 1 && matcher->start( 1, u_stat ) < 0 ) ){
+      // case 1: a rule without capture groups matches
+      // case 2b: a rule with one capture group matches, but group 1 is
+      // empty. use group 0
+      int start = matcher->start( 0, u_stat );
+      int end = matcher->end( 0, u_stat );
+      results.push_back( span( start, end ) );
+      pre = span( 0, start );
+      post = span( end, line.length() );
+    }
+    else if ( groups == 1 ){
+      // case 2a: a rule with one capture group matches
+      int start = matcher->start( 1, u_stat );
+      int end = matcher->end( 1, u_stat );
+      results.push_back( span( start, end ) );
+      pre = span( 0, start );
+      post = span( end, line.length() );
+    }
+    else {
+      // a rule with more then 1 capture group
+      // this is quite ugly...
+      int end = 0;
+      for ( int i=0; i <= groups; ++i ){
+	u_stat = U_ZERO_ERROR;
+	int start = matcher->start( i, u_stat );
+	if ( U_FAILURE(u_stat) ){
+	  break;
+	}
+	if ( start < 0 ){
+	  continue;
+	}
+	if ( start > end ){
+	  pre = span( end, start );
+	}
+	end = matcher->end( i, u_stat );
+	if ( U_FAILURE(u_stat) ){
+	  break;
+	}
+	results.push_back( span( start, end ) );
+      }
+      post = span( max( end, 0 ), line.length() );
+    }
+    if ( debug ){
+      for ( const auto& r : results ){
+	cerr << "result = " << UnicodeString( line, r.first,
+					      r.second - r.first ) << endl;
+      }
+    }
+    return true;
+  }
+
+  inline UnicodeString span_string( const UnicodeString& line,
+				    const UnicodeRegexMatcher::span& s ){
+    return UnicodeString( line, s.first, s.second - s.first );
+  }
+  }
+  /// @endcond
+
   bool UnicodeRegexMatcher::match_all( const UnicodeString& line,
 				       UnicodeString& pre,
 				       UnicodeString& post ){
@@ -223,143 +690,48 @@ namespace TiCC {
 
       if match_all returns true, you need to call get_match() to get results
     */
-    UErrorCode u_stat = U_ZERO_ERROR;
+    if ( _debug ){
+      cerr << "start matcher [" << line << "], pattern = " << Pattern() << endl;
+    }
+    vector<span> spans;
+    span pre_span;
+    span post_span;
     pre = "";
     post = "";
     _results.clear();
-    if ( _matcher ){
-      if ( _debug ){
-	cerr << "start matcher [" << line << "], pattern = " << Pattern() << endl;
-      }
-      _matcher->reset( line );
-      if ( _matcher->find() ){
-	if ( _debug ){
-	  cerr << "matched " << line << endl;
-	  for ( int i=0; i <= _matcher->groupCount(); ++i ){
-	    cerr << "group[" << i << "] =" << _matcher->group(i,u_stat) << endl;
-	  }
-	}
-	if ( _matcher->groupCount() == 0 ){
-	  // case 1: a rule without capture groups matches
-	  UnicodeString us = _matcher->group(0,u_stat) ;
-	  if ( _debug ){
-	    cerr << "case 1, result = " << us << endl;
-	  }
-	  _results.push_back( us );
-	  int start = _matcher->start( 0, u_stat );
-	  if ( start > 0 ){
-	    pre = UnicodeString( line, 0, start );
-	    if ( _debug ){
-	      cerr << "found pre " << pre << endl;
-	    }
-	  }
-	  int end = _matcher->end( 0, u_stat );
-	  if ( end < line.length() ){
-	    post = UnicodeString( line, end );
-	    if ( _debug ){
-	      cerr << "found post " << post << endl;
-	    }
-	  }
-	  return true;
-	}
-	else if ( _matcher->groupCount() == 1 ){
-	  // case 2: a rule with one capture group matches
-	  int start = _matcher->start( 1, u_stat );
-	  if ( start >= 0 ){
-	    UnicodeString us = _matcher->group(1,u_stat) ;
-	    if ( _debug ){
-	      cerr << "case 2a , result = " << us << endl;
-	    }
-	    _results.push_back( us );
-	    if ( start > 0 ){
-	      pre = UnicodeString( line, 0, start );
-	      if ( _debug ){
-		cerr << "found pre " << pre << endl;
-	      }
-	    }
-	    int end = _matcher->end( 1, u_stat );
-	    if ( end < line.length() ){
-	      post = UnicodeString( line, end );
-	      if ( _debug ){
-		cerr << "found post " << post << endl;
-	      }
-	    }
-	  }
-	  else {
-	    // group 1 is empty, return group 0
-	    UnicodeString us = _matcher->group(0,u_stat) ;
-	    if ( _debug ){
-	      cerr << "case 2b , result = " << us << endl;
-	    }
-	    _results.push_back( us );
-	    start = _matcher->start( 0, u_stat );
-	    if ( start > 0 ){
-	      pre = UnicodeString( line, 0, start );
-	      if ( _debug ){
-		cerr << "found pre " << pre << endl;
-	      }
-	    }
-	    int end = _matcher->end( 0, u_stat );
-	    if ( end < line.length() ){
-	      post = UnicodeString( line, end );
-	      if ( _debug ){
-		cerr << "found post " << post << endl;
-	      }
-	    }
-	  }
-	  return true;
-	}
-	else {
-	  // a rule with more then 1 capture group
-	  // this is quite ugly...
-	  int end = 0;
-	  for ( int i=0; i <= _matcher->groupCount(); ++i ){
-	    if ( _debug ){
-	      cerr << "group " << i << endl;
-	    }
-	    u_stat = U_ZERO_ERROR;
-	    int start = _matcher->start( i, u_stat );
-	    if ( _debug ){
-	      cerr << "start = " << start << endl;
-	    }
-	    if ( !U_FAILURE(u_stat) ){
-	      if ( start < 0 ){
-		continue;
-	      }
-	    }
-	    else
-	      break;
-	    if ( start > end ){
-	      pre = UnicodeString( line, end, start );
-	      if ( _debug ){
-		cerr << "found pre " << pre << endl;
-	      }
-	    }
-	    end = _matcher->end( i, u_stat );
-	    if ( _debug ){
-	      cerr << "end = " << end << endl;
-	    }
-	    if ( !U_FAILURE(u_stat) ){
-	      _results.push_back( UnicodeString( line, start, end - start ) );
-	      if ( _debug ){
-		cerr << "added result " << _results.back() << endl;
-	      }
-	    }
-	    else
-	      break;
-	  }
-	  if ( end < line.length() ){
-	    post = UnicodeString( line, end );
-	    if ( _debug ){
-	      cerr << "found post " << post << endl;
-	    }
-	  }
-	  return true;
-	}
-      }
+    matcher_lease matcher( *this );
+    if ( !match_spans( matcher.get(), line, _debug,
+		       spans, pre_span, post_span ) ){
+      return false;
     }
-    _results.clear();
-    return false;
+    for ( const auto& s : spans ){
+      _results.push_back( span_string( line, s ) );
+    }
+    // NOTE: historically, pre was taken from pre_span.first with a LENGTH
+    // of pre_span.second. That only differs for rules with more than one
+    // capture group. Callers may depend on it, so keep it that way
+    pre = UnicodeString( line, pre_span.first, pre_span.second );
+    post = span_string( line, post_span );
+    return true;
+  }
+
+  bool UnicodeRegexMatcher::match_offsets( const UnicodeString& line,
+					   vector<span>& results,
+					   span& pre,
+					   span& post ) const {
+    /// apply the RegexMatcher on an Unicode line, returning offsets
+    /*!
+      \param line the UnicodeString to analyze
+      \param results the offsets of the matches, the same parts that
+      match_all() stores for get_match()
+      \param pre the offsets of the part of the line BEFORE the match
+      \param post the offsets of the part of the line AFTER the match
+      \return true when there was some match found
+
+      This doesn't copy any strings, and is thread safe.
+    */
+    matcher_lease matcher( *this );
+    return match_spans( matcher.get(), line, _debug, results, pre, post );
   }
 
   const UnicodeString UnicodeRegexMatcher::get_match( unsigned int n ) const{
@@ -395,13 +767,64 @@ namespace TiCC {
     const int maxWords = 256;
     UnicodeString words[maxWords];
     UErrorCode status = U_ZERO_ERROR;
-    int numWords = _matcher->split( us, words, maxWords, status );
+    matcher_lease matcher( *this );
+    int numWords = matcher->split( us, words, maxWords, status );
     for ( int i = 0; i < numWords; ++i ){
       result.push_back( words[i] );
     }
     return numWords;
   }
 
+  int UnicodeRegexMatcher::split( const UnicodeString& us,
+				  vector<span>& result ) const {
+    /// split a UnicodeString using the stored pattern, returning offsets
+    /*!
+      \param us the UnicodeString to split
+      \param result a vector with the offsets of the splitted parts
+      \return the number of elements in the result
+
+      The parts are the same as RegexMatcher::split() gives, including
+      the capture groups of the pattern. But there is no limit on the
+      number of parts. A capture group that didn't match gives an empty
+      part. This doesn't copy any strings, and is thread safe.
+    */
+    result.clear();
+    int32_t len = us.length();
+    if ( len == 0 ){
+      return 0;
+    }
+    matcher_lease matcher( *this );
+    matcher->reset( us );
+    UErrorCode status = U_ZERO_ERROR;
+    int groups = matcher->groupCount();
+    int32_t next = 0;
+    while ( true ){
+      if ( !matcher->find() ){
+	// all the remaining text goes into the last part
+	result.push_back( span( next, len ) );
+	break;
+      }
+      int32_t start = matcher->start( status );
+      result.push_back( span( next, start ) );
+      next = matcher->end( status );
+      for ( int g=1; g <= groups; ++g ){
+	int32_t g_start = matcher->start( g, status );
+	if ( g_start < 0 ){
+	  result.push_back( span( start, start ) );
+	}
+	else {
+	  result.push_back( span( g_start, matcher->end( g, status ) ) );
+	}
+      }
+      if ( next == len ){
+	// the delimiter was at the end. add an empty last part
+	result.push_back( span( len, len ) );
+	break;
+      }
+    }
+    return result.size();
+  }
+
   UniFilter::UniFilter(): _trans(0) {
     /// create a Unicode Filter object
   }
@@ -410,9 +833,155 @@ namespace TiCC {
     delete _trans;
   }
 
+  /// @cond HIDDEN
+  namespace {
+  Transliterator *create_transliterator( const UnicodeString& rules,
+					 const UnicodeString& name,
+					 bool cached = true ){
+    // compile the rules into a new Transliterator. Compiling large rule
+    // sets is expensive, and ICU can't serialize the result, so we keep
+    // the compiled prototypes in a process wide cache, and hand out clones.
+    // The cache is bounded, so programs creating many different filters
+    // don't keep them all alive
+    const size_t max_cached = 32;
+    static mutex cache_lock;
+    static unordered_map<string,unique_ptr<Transliterator>> cache;
+    string key;
+    if ( cached ){
+      name.toUTF8String( key );
+      key += '\0';
+      rules.toUTF8String( key );
+      lock_guard<mutex> lock( cache_lock );
+      auto it = cache.find( key );
+      if ( it != cache.end() ){
+	return it->second->clone();
+      }
+    }
+    UErrorCode stat = U_ZERO_ERROR;
+    UParseError err;
+    Transliterator *trans = Transliterator::createFromRules( name,
+							     rules,
+							     UTRANS_FORWARD,
+							     err,
+							     stat );
+    if ( U_FAILURE( stat ) ){
+      delete trans;
+      string msg = "creating UniFilter: " + UnicodeToUTF8( name )
+	+ " failed\n" + "error in rules, line=" + toString(err.line)
+	+ " at position: " + toString(err.offset);
+      throw runtime_error( msg );
+    }
+    if ( cached ){
+      lock_guard<mutex> lock( cache_lock );
+      if ( cache.find( key ) == cache.end() ){
+	if ( cache.size() >= max_cached ){
+	  cache.erase( cache.begin() );
+	}
+	cache[key].reset( trans->clone() );
+      }
+    }
+    return trans;
+  }
+  }
+  /// @endcond
+
+  void UniFilter::compile() const {
+    /// compile the pending rules, together with the current ones.
+    /*!
+      This is postponed until the filter is needed, so adding N rules
+      compiles only once. Errors in added rules show up here too, and
+      are thrown again on every next use of the filter.
+    */
+    if ( _pending.empty() ){
+      return;
+    }
+    if ( !_error.empty() ){
+      // don't try to compile the same bad rules on every call
+      throw runtime_error( _error );
+    }
+    UnicodeString rules;
+    UnicodeString id = "generatedId";
+    if ( _trans ){
+      _trans->toRules( rules, false );
+      id = _trans->getID();
+    }
+    for ( const auto& rule : _pending ){
+      rules += rule;
+    }
+    // every add() gives a new set of rules, so don't cache them
+    Transliterator *trans = 0;
+    try {
+      trans = create_transliterator( rules, id, false );
+    }
+    catch ( const runtime_error& e ){
+      _error = e.what();
+      throw;
+    }
+    _pending.clear();
+    delete _trans;
+    _trans = trans;
+    _token = make_shared<char>( 0 );
+  }
+
+  /// @cond HIDDEN
+  namespace {
+  struct filter_clone {
+    // expires when the filter is changed or destroyed
+    weak_ptr<char> token;
+    unique_ptr<Transliterator> trans;
+  };
+  }
+  /// @endcond
+
+  Transliterator *UniFilter::thread_transliterator(){
+    /// return the Transliterator for the calling thread
+    /*!
+      \return a clone of the compiled filter, private to this thread. NULL
+      when the filter is not initialized
+
+      The clones live as long as their thread, so OpenMP workers keep
+      them over many batches. Clones of changed or destroyed filters are
+      removed when the thread makes a new clone.
+    */
+    thread_local map<const UniFilter*,filter_clone> clones;
+    {
+      shared_lock<shared_mutex> lock( _lock );
+      if ( _pending.empty() ){
+	if ( !_trans ){
+	  return 0;
+	}
+	auto it = clones.find( this );
+	if ( it != clones.end() && !it->second.token.expired() ){
+	  return it->second.trans.get();
+	}
+      }
+    }
+    unique_lock<shared_mutex> lock( _lock );
+    compile();
+    if ( !_trans ){
+      return 0;
+    }
+    for ( auto it = clones.begin(); it != clones.end(); ){
+      if ( it->second.token.expired() ){
+	it = clones.erase( it );
+      }
+      else {
+	++it;
+      }
+    }
+    filter_clone& clone = clones[this];
+    if ( !clone.trans ){
+      clone.token = _token;
+      clone.trans.reset( _trans->clone() );
+    }
+    return clone.trans.get();
+  }
+
   UnicodeString UniFilter::get_rules() const {
     /// extract the current rules from the Unicode Filter
     UnicodeString result;
+    unique_lock<shared_mutex> lock( _lock );
+    compile();
     if ( !_trans ){
       throw runtime_error( "UniFilter::getRules(), filter not initialized." );
     }
@@ -428,23 +997,14 @@ namespace TiCC {
       \param rules a Unicode string with filter rules
       \param name a name for the filter (used for error messages)
       \return true on succes, will throw on error
+
+      Filters with the same rules and name share the compiled rules.
     */
-    if ( _trans ){
+    if ( is_initialized() ){
       throw logic_error( "UniFilter::init():, filter already initialized." );
     }
-    UErrorCode stat = U_ZERO_ERROR;
-    UParseError err;
-    _trans = Transliterator::createFromRules( name,
-						   rules,
-						   UTRANS_FORWARD,
-						   err,
-						   stat );
-    if ( U_FAILURE( stat ) ){
-      string msg = "creating UniFilter: " + UnicodeToUTF8( name )
-	+ " failed\n" + "error in rules, line=" + toString(err.line)
-	+ " at position: " + toString(err.offset);
-      throw runtime_error( msg );
-    }
+    _trans = create_transliterator( rules, name );
+    _token = make_shared<char>( 0 );
     return true;
   }
 
@@ -519,42 +1079,56 @@ namespace TiCC {
       \param line the inputline
       \return the resulting filtered line
     */
-    if ( !_trans ){
+    Transliterator *trans = thread_transliterator();
+    if ( !trans ){
       //      throw logic_error( "UniFilter not initialized." );
       return line;
     }
     else {
       UnicodeString result = line;
-      _trans->transliterate( result );
+      trans->transliterate( result );
       return result;
     }
   }
 
+  void UniFilter::filter_batch( vector<UnicodeString>& lines ){
+    /// apply the Unicode Filter on a lot of lines, in parallel
+    /*!
+      \param lines the lines to filter. They are replaced by the result.
+
+      The work is spread over OpenMP threads
+    */
+    // compile the filter first, so errors are thrown outside the
+    // parallel region
+    if ( !thread_transliterator() ){
+      return;
+    }
+#pragma omp parallel
+    {
+      // look up the clone only once per thread
+      Transliterator *trans = thread_transliterator();
+#pragma omp for schedule(dynamic,256)
+      for ( size_t i=0; i < lines.size(); ++i ){
+	trans->transliterate( lines[i] );
+      }
+    }
+  }
+
   bool UniFilter::add( const UnicodeString& in ){
     /// add an extra rule to the Unicode Filter
     /*!
       \param in a rule to add
+
+      The rule is only compiled on the next use of the filter, together
+      with all other rules added in the mean time. So errors in the rule
+      are only reported then.
     */
-    //
-    // TODO: cache multiple add's and only (re-)init the transliterator
-    //       once. On first use of the filter() method.
-    //       caveat: Warnings about problems will be postponed too
-    //
-    UnicodeString uline = to_icu_rule( in );
-    UnicodeString old_rules;
-    UnicodeString id = "generatedId";
-    if ( _trans ){
-      _trans->toRules( old_rules, false );
-      id = _trans->getID();
-      delete _trans;
-      _trans = 0;
-    }
-    // cerr << "OLD rule: " << old_rules << endl;
-    // cerr << "add rule: " << uline << endl;
-    old_rules += uline;
-    // cerr << "NEW rule: " << old_rules << endl;
-    // cerr << "ID = " << id << endl;
-    return init( old_rules, id );
+    UnicodeString rule = to_icu_rule( in );
+    unique_lock<shared_mutex> lock( _lock );
+    _pending.push_back( rule );
+    // outdate the clones of all threads
+    _token.reset();
+    return true;
   }
 
   bool UniFilter::add( const string& line ){
@@ -572,79 +1146,172 @@ namespace TiCC {
     return os;
   }
 
+  /// @cond HIDDEN
+  namespace {
+  Transliterator *diacritics_transliterator(){
+    // return the diacritics filter for the calling thread.
+    // Creating a Transliterator from an ID is expensive, cloning is not
+    static const unique_ptr<Transliterator> prototype = [](){
+      UErrorCode stat = U_ZERO_ERROR;
+      unique_ptr<Transliterator> trans;
+      trans.reset( Transliterator::createInstance( "NFD; [:M:] Remove; NFC",
+						   UTRANS_FORWARD,
+						   stat ) );
+      if ( U_FAILURE( stat ) ){
+	throw runtime_error( "filter_diacritics()  transliterator not created" );
+      }
+      return trans;
+    }();
+    thread_local unique_ptr<Transliterator> trans( prototype->clone() );
+    return trans.get();
+  }
+  }
+  /// @endcond
+
   UnicodeString filter_diacritics( const UnicodeString& in ) {
     /// filter ALL diacritics from an UnicodeString
     /*!
       \param in the UnicodeString to filter from
       \return an UnicodeString with all diacrytics removed
+
+      This is thread safe.
     */
-    static Transliterator *trans = 0;
-    if ( trans == 0 ){
-      UErrorCode stat = U_ZERO_ERROR;
-      trans = Transliterator::createInstance( "NFD; [:M:] Remove; NFC",
-						   UTRANS_FORWARD,
-						   stat );
-      if ( U_FAILURE( stat ) ){
-	throw runtime_error( "filter_diacritics()  transliterator not created" );
-      }
-    }
     UnicodeString result = in;
-    trans->transliterate( result );
+    diacritics_transliterator()->transliterate( result );
     return result;
   }
 
-  vector<UnicodeString> split_at( const UnicodeString& src,
-				  const UnicodeString& sep,
-				  size_t max ){
-    /// split an UnicodeString
+  void filter_diacritics_batch( vector<UnicodeString>& lines ){
+    /// filter ALL diacritics from a lot of lines, in parallel
+    /*!
+      \param lines the lines to filter. They are replaced by the result.
+    */
+    // create the prototype outside the parallel region
+    diacritics_transliterator();
+#pragma omp parallel
+    {
+      Transliterator *trans = diacritics_transliterator();
+#pragma omp for schedule(dynamic,256)
+      for ( size_t i=0; i < lines.size(); ++i ){
+	trans->transliterate( lines[i] );
+      }
+    }
+  }
+
+  UnicodeCharSet::UnicodeCharSet( const UnicodeString& chars ){
+    /// create a set of characters
+    /*!
+      \param chars the characters in the set. Surrogate pairs are taken
+      as one (supplementary) character
+    */
+    int32_t len = chars.length();
+    for ( int32_t i=0; i < len; ){
+      UChar32 c = chars.char32At( i );
+      i += U16_LENGTH( c );
+      if ( c < 0x10000 ){
+	size_t word = c >> 6;
+	if ( word >= _bmp.size() ){
+	  _bmp.resize( word + 1 );
+	}
+	_bmp[word] |= uint64_t(1) << ( c & 63 );
+      }
+      else {
+	_supplementary.push_back( c );
+      }
+    }
+    sort( _supplementary.begin(), _supplementary.end() );
+  }
+
+  int32_t UnicodeCharSet::find_first( const UnicodeString& src,
+				      int32_t pos,
+				      int32_t& len ) const {
+    /// find the first character of the set in a string
+    /*!
+      \param src the string to search
+      \param pos the position to start
+      \param len the length of the character found: 1, or 2 for a
+      surrogate pair
+      \return the position found, or -1 when not present
+    */
+    const UChar *buf = src.getBuffer();
+    int32_t size = src.length();
+    if ( buf == 0 ){
+      return -1;
+    }
+    int32_t i = pos;
+    while ( i < size ){
+      UChar32 c = buf[i];
+      int32_t start = i++;
+      if ( U16_IS_LEAD( c ) && i < size && U16_IS_TRAIL( buf[i] ) ){
+	c = U16_GET_SUPPLEMENTARY( c, buf[i] );
+	++i;
+      }
+      if ( contains( c ) ){
+	len = i - start;
+	return start;
+      }
+    }
+    return -1;
+  }
+
+  size_t split_at( const UnicodeString& src,
+		   const UnicodeString& sep,
+		   vector<UnicodeSpan>& results,
+		   size_t max ){
+    /// split an UnicodeString, giving offsets
     /*!
       \param src the UnicodeString to split
       \param sep the separator to split at
+      \param results the offsets of the splitted parts
       \param max limit the size off the result to max, when max > 0
       leaving the remainder in the last part of the result
-      \return a vector with the splitted parts
+      \return the number of parts
 
-      \note this function skips empty entries (e.g. when two or more separators
-      co-incide)
+      \note this function skips empty entries (e.g. when two or more
+      separators co-incide)
     */
     if ( sep.isEmpty() ){
       throw runtime_error( "TiCC::split_at(): separator is empty!" );
     }
-    vector<UnicodeString> results;
+    results.clear();
+    int32_t len = src.length();
     size_t cnt = 0;
-    int pos = 0;
+    int32_t pos = 0;
     while ( pos != -1 ){
-      UnicodeString res;
-      int p = src.indexOf( sep, pos );
+      int32_t start = pos;
+      int32_t end;
+      int32_t p = src.indexOf( sep, pos );
       if ( p == -1 ){
-	res = src.tempSubString( pos );
+	end = len;
 	pos = p;
       }
       else {
-	res = src.tempSubString( pos, p - pos );
+	end = p;
 	pos = p + sep.length();
       }
-      if ( !res.isEmpty() ){
+      if ( end > start ){
 	++cnt;
-	results.push_back( res );
+	results.push_back( UnicodeSpan( start, end ) );
       }
       if ( max != 0 && cnt >= max-1 ){
 	if ( pos != -1 ){
-	  results.push_back( src.tempSubString( pos ) );
+	  results.push_back( UnicodeSpan( pos, len ) );
 	}
 	break;
       }
     }
-    return results;
+    return results.size();
   }
 
-  vector<UnicodeString> split_exact_at( const UnicodeString& src,
-					const UnicodeString& sep ){
-    /// split an UnicodeString
+  size_t split_exact_at( const UnicodeString& src,
+			 const UnicodeString& sep,
+			 vector<UnicodeSpan>& results ){
+    /// split an UnicodeString, giving offsets
     /*!
       \param src the UnicodeString to split
       \param sep the separator string to split at
-      \return a vector with the splitted parts
+      \param results the offsets of the splitted parts
+      \return the number of parts
 
       \note this function creates empty entries (e.g. when two or more
       separators co-incide)
@@ -652,91 +1319,194 @@ namespace TiCC {
     if ( sep.isEmpty() ){
       throw runtime_error( "TiCC::split_at(): separator is empty!" );
     }
-    vector<UnicodeString> results;
-    int pos = 0;
+    results.clear();
+    int32_t len = src.length();
+    int32_t pos = 0;
     while ( pos != -1 ){
-      UnicodeString res;
-      int p = src.indexOf( sep, pos );
+      int32_t p = src.indexOf( sep, pos );
       if ( p == -1 ){
-	res = src.tempSubString( pos );
+	results.push_back( UnicodeSpan( pos, len ) );
 	pos = p;
       }
       else {
-	res = src.tempSubString( pos, p - pos );
+	results.push_back( UnicodeSpan( pos, p ) );
 	pos = p + sep.length();
       }
-      results.push_back( res );
-    }
-    return results;
-  }
-
-  int find_first_of( const UnicodeString& src,
-		     const UnicodeString& seps,
-		     int pos ){
-    /// find the first occurrence of one of the seps in a string
-    /*!
-      \param src the string to search
-      \param seps a list of separator characters
-      \param pos start position for the search
-      \return the position found, or -1 when not present
-    */
-    int result = src.length()+10;
-    for ( int i=0; i < seps.length(); ++i ){
-      int p = src.indexOf( seps[i], pos );
-      if ( p >= 0 ){
-	result = min( p, result );
-      }
     }
-    if ( result >= 0 && result < src.length() ){
-      return result;
-    }
-    return -1;
+    return results.size();
   }
 
-  vector<UnicodeString> split_at_first_of( const UnicodeString& src,
-					   const UnicodeString& seps,
-					   size_t max ){
-    /// split an UnicodeString
+  size_t split_at_first_of( const UnicodeString& src,
+			    const UnicodeCharSet& seps,
+			    vector<UnicodeSpan>& results,
+			    size_t max ){
+    /// split an UnicodeString, giving offsets
     /*!
       \param src the UnicodeString to split
-      \param seps a list of separator characters
+      \param seps the set of separator characters
+      \param results the offsets of the splitted parts
       \param max limit the size off the result to max, when max > 0
       leaving the remainder in the last part of the result
-      \return a vector with the splitted parts
+      \return the number of parts
 
-      \note this function skips empty entries (e.g. when two or more separators
-      co-incide)
+      \note this function skips empty entries (e.g. when two or more
+      separators co-incide)
     */
-    if ( seps.isEmpty() ){
+    if ( seps.empty() ){
       throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
     }
-    vector<UnicodeString> results;
+    results.clear();
+    int32_t len = src.length();
     size_t cnt = 0;
-    int pos = 0;
+    int32_t pos = 0;
     while ( pos != -1 ){
-      UnicodeString res;
-      int e = find_first_of( src, seps, pos );
+      int32_t start = pos;
+      int32_t end;
+      int32_t sep_len = 0;
+      int32_t e = seps.find_first( src, pos, sep_len );
       if ( e == -1 ){
-	res = src.tempSubString( pos );
+	end = len;
 	pos = e;
       }
       else {
-	res = src.tempSubString( pos, e - pos );
-	pos = e+1;
+	end = e;
+	pos = e + sep_len;
       }
-      if ( !res.isEmpty() ){
-	results.push_back( res );
+      if ( end > start ){
+	results.push_back( UnicodeSpan( start, end ) );
 	++cnt;
       }
       if ( max != 0 && cnt >= max-1 ){
 	if ( pos != -1 ){
-	  results.push_back( src.tempSubString( pos ) );
+	  results.push_back( UnicodeSpan( pos, len ) );
 	}
 	break;
       }
     }
+    return results.size();
+  }
+
+  size_t split_exact_at_first_of( const UnicodeString& src,
+				  const UnicodeCharSet& seps,
+				  vector<UnicodeSpan>& results ){
+    /// split an UnicodeString, giving offsets
+    /*!
+      \param src the UnicodeString to split
+      \param seps the set of separator characters
+      \param results the offsets of the splitted parts
+      \return the number of parts
+
+      \note this function may create empty entries (e.g. when two or more
+      separators co-incide)
+    */
+    if ( seps.empty() ){
+      throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
+    }
+    results.clear();
+    int32_t len = src.length();
+    int32_t pos = 0;
+    while ( pos != -1 ){
+      int32_t sep_len = 0;
+      int32_t e = seps.find_first( src, pos, sep_len );
+      if ( e == -1 ){
+	results.push_back( UnicodeSpan( pos, len ) );
+	pos = e;
+      }
+      else {
+	results.push_back( UnicodeSpan( pos, e ) );
+	pos = e + sep_len;
+      }
+    }
+    return results.size();
+  }
+
+  size_t split( const UnicodeString& src,
+		vector<UnicodeSpan>& results,
+		size_t max ){
+    /// split an UnicodeString at whitespace, giving offsets
+    /*!
+      \param src the UnicodeString to split
+      \param results the offsets of the splitted parts
+      \param max limit the size off the result to max, when max > 0
+      leaving the remainder in the last part of the result
+      \return the number of parts
+
+      \note this function skips empty entries (e.g. when two or more
+      separators co-incide)
+    */
+    static const UnicodeCharSet spaces( UnicodeFromUTF8( " \r\t\n" ) );
+    return split_at_first_of( src, spaces, results, max );
+  }
+
+  /// @cond HIDDEN
+  namespace {
+  vector<UnicodeString> span_strings( const UnicodeString& src,
+				      const vector<UnicodeSpan>& spans ){
+    // copy the parts of src
+    vector<UnicodeString> results;
+    results.reserve( spans.size() );
+    for ( const auto& span : spans ){
+      results.push_back( src.tempSubString( span.first,
+					    span.second - span.first ) );
+    }
     return results;
   }
+  }
+  /// @endcond
+
+  vector<UnicodeString> split_at( const UnicodeString& src,
+				  const UnicodeString& sep,
+				  size_t max ){
+    /// split an UnicodeString
+    /*!
+      \param src the UnicodeString to split
+      \param sep the separator to split at
+      \param max limit the size off the result to max, when max > 0
+      leaving the remainder in the last part of the result
+      \return a vector with the splitted parts
+
+      \note this function skips empty entries (e.g. when two or more separators
+      co-incide)
+    */
+    vector<UnicodeSpan> spans;
+    split_at( src, sep, spans, max );
+    return span_strings( src, spans );
+  }
+
+  vector<UnicodeString> split_exact_at( const UnicodeString& src,
+					const UnicodeString& sep ){
+    /// split an UnicodeString
+    /*!
+      \param src the UnicodeString to split
+      \param sep the separator string to split at
+      \return a vector with the splitted parts
+
+      \note this function creates empty entries (e.g. when two or more
+      separators co-incide)
+    */
+    vector<UnicodeSpan> spans;
+    split_exact_at( src, sep, spans );
+    return span_strings( src, spans );
+  }
+
+  vector<UnicodeString> split_at_first_of( const UnicodeString& src,
+					   const UnicodeString& seps,
+					   size_t max ){
+    /// split an UnicodeString
+    /*!
+      \param src the UnicodeString to split
+      \param seps a list of separator characters
+      \param max limit the size off the result to max, when max > 0
+      leaving the remainder in the last part of the result
+      \return a vector with the splitted parts
+
+      \note this function skips empty entries (e.g. when two or more separators
+      co-incide)
+    */
+    vector<UnicodeSpan> spans;
+    split_at_first_of( src, UnicodeCharSet( seps ), spans, max );
+    return span_strings( src, spans );
+  }
 
   vector<UnicodeString> split( const UnicodeString& src,
 			       size_t max ){
@@ -750,8 +1520,9 @@ namespace TiCC {
       \note this function skips empty entries (e.g. when two or more separators
       co-incide)
     */
-    static UnicodeString spaces = TiCC::UnicodeFromUTF8( " \r\t\n" );
-    return split_at_first_of( src, spaces, max );
+    vector<UnicodeSpan> spans;
+    split( src, spans, max );
+    return span_strings( src, spans );
   }
 
   vector<UnicodeString> split_exact_at_first_of( const UnicodeString& src,
@@ -765,25 +1536,9 @@ namespace TiCC {
       \note this function may create empty entries (e.g. when two or more
       separators co-incide)
     */
-    if ( seps.isEmpty() ){
-      throw runtime_error( "TiCC::split_at_first_of(): separators are empty!" );
-    }
-    vector<UnicodeString> results;
-    int pos = 0;
-    while ( pos != -1 ){
-      UnicodeString res;
-      int e = find_first_of( src, seps, pos );
-      if ( e == -1 ){
-	res = src.tempSubString( pos );
-	pos = e;
-      }
-      else {
-	res = src.tempSubString( pos, e - pos );
-	pos = e+1;
-      }
-      results.push_back( res ); // even when empty
-    }
-    return results;
+    vector<UnicodeSpan> spans;
+    split_exact_at_first_of( src, UnicodeCharSet( seps ), spans );
+    return span_strings( src, spans );
   }
 
   string utf8_lowercase( const string& in ){
@@ -902,6 +1657,127 @@ namespace TiCC {
     return is;
   }
 
+  /// @cond HIDDEN
+  const size_t LINE_READER_BLOCK = 64*1024;
+  /// @endcond
+
+  UnicodeLineReader::UnicodeLineReader( istream& is,
+					const string& encoding,
+					const string& normalization,
+					const char delim ):
+    _is( is ),
+    _converter( 0 ),
+    _normalizer( normalization ),
+    _delim( delim ),
+    _buffer( LINE_READER_BLOCK ),
+    _pos( 0 ),
+    _end( 0 ),
+    _eof( false )
+  {
+    /// create a line reader on an input stream
+    /*!
+      \param is The stream to read from. The reader reads ahead in large
+      blocks, so don't read from the stream yourself after this.
+      \param encoding The encoding of the input stream. Default UTF8
+      \param normalization the normalization to use. Default NFC
+      \param delim The line delimiter. Default '\n'
+    */
+    // UTF-8 is converted directly, without a converter
+    if ( !encoding.empty()
+	 && !is_utf8_name( encoding ) ){
+      UErrorCode err = U_ZERO_ERROR;
+      _converter = ucnv_open( encoding.c_str(), &err );
+      if ( U_FAILURE(err) ){
+	throw runtime_error( "UnicodeLineReader: unsupported encoding: "
+			     + encoding );
+      }
+    }
+  }
+
+  UnicodeLineReader::~UnicodeLineReader(){
+    if ( _converter ){
+      ucnv_close( _converter );
+    }
+  }
+
+  bool UnicodeLineReader::fill_buffer(){
+    /// read the next block from the stream
+    /*!
+      \return false when nothing could be read anymore
+    */
+    _pos = 0;
+    _end = 0;
+    if ( _is ){
+      _is.read( _buffer.data(), _buffer.size() );
+      _end = _is.gcount();
+    }
+    return _end > 0;
+  }
+
+  void UnicodeLineReader::convert( const char *s,
+				   size_t len,
+				   UnicodeString& us ){
+    /// convert a character buffer into us, reusing the buffer of us, and
+    /// normalize it
+    /*!
+      \param s the characters to convert
+      \param len the number of characters
+      \param us the UnicodeString to store the result in
+    */
+    if ( !convert_to_unicode( _converter, s, len, us ) ){
+      _normalizer.normalize_inplace( us );
+    }
+  }
+
+  bool UnicodeLineReader::getline( UnicodeString& us ){
+    /// read the next line
+    /*!
+      \param us the UnicodeString to read. Its buffer is reused.
+      \return true when a line is read, false at the end of the input.
+
+      Like std::getline(), the last line may lack a delimiter, and an empty
+      string after the last delimiter doesn't count as a line.
+    */
+    us.remove();
+    if ( _eof ){
+      return false;
+    }
+    _line.clear();
+    bool extracted = false;
+    while ( true ){
+      if ( _pos == _end
+	   && !fill_buffer() ){
+	break;
+      }
+      extracted = true;
+      const char *start = _buffer.data() + _pos;
+      size_t avail = _end - _pos;
+      const char *hit
+	= static_cast<const char*>( memchr( start, _delim, avail ) );
+      if ( hit ){
+	size_t len = hit - start;
+	_pos += len + 1;
+	if ( _line.empty() ){
+	  // the whole line is in the buffer. convert it from there
+	  convert( start, len, us );
+	}
+	else {
+	  _line.append( start, len );
+	  convert( _line.data(), _line.size(), us );
+	}
+	return true;
+      }
+      _line.append( start, avail );
+      _pos = _end;
+    }
+    _eof = true;
+    if ( !extracted ){
+      return false;
+    }
+    convert( _line.data(), _line.size(), us );
+    return true;
+  }
+
   UnicodeString format_non_printable( const UChar32 c ){
     /// format a (maybe weird)  character into a printable form
     // useful for debugging
@@ -0,0 +1,1115 @@
+/*
+  Copyright (c) 2006 - 2026
+  CLST  - Radboud University
+  ILK   - Tilburg University
+
+  This file is part of ticcutils
+
+  ticcutils is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 3 of the License, or
+  (at your option) any later version.
+
+  ticcutils is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  For questions and suggestions, see:
+      https://github.com/LanguageMachines/ticcutils/issues
+  or send mail to:
+      lamasoftware (at ) science.ru.nl
+
+*/
+
+// A collection of micro benchmarks for the performance critical parts of
+// ticcutils. NOT part of the testsuite, run it by hand:
+//
+//   ./benchmark [--size=N] [suite...]
+//
+// without a suite, all benchmarks are run.
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <unordered_map>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "config.h"
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "ticcutils/StringOps.h"
+#include "ticcutils/Unicode.h"
+#include "ticcutils/UniHash.h"
+#include "ticcutils/UniTrie.h"
+#include "ticcutils/CommandLine.h"
+#include "ticcutils/LogStream.h"
+
+using namespace std;
+using namespace icu;
+
+/// a simple wall clock stopwatch
+class StopWatch {
+public:
+  StopWatch(): _start( chrono::steady_clock::now() ){};
+  double seconds() const {
+    chrono::duration<double> d = chrono::steady_clock::now() - _start;
+    return d.count();
+  }
+private:
+  chrono::steady_clock::time_point _start;
+};
+
+int max_threads(){
+#ifdef HAVE_OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+vector<int> thread_counts(){
+  /// 1, 2, 4, ... up to the number of available threads
+  vector<int> result;
+  int max = max_threads();
+  for ( int t=1; t < max; t *= 2 ){
+    result.push_back( t );
+  }
+  result.push_back( max );
+  return result;
+}
+
+void report( const string& what, size_t items, double secs ){
+  cout << "  " << left << setw(44) << what << right
+       << fixed << setprecision(3) << setw(9) << secs << " s "
+       << setw(12) << setprecision(0) << items / secs << " items/s" << endl;
+}
+
+size_t heap_in_use(){
+  /// the number of bytes allocated on the heap, 0 when unknown
+#if defined(__GLIBC__) && ( __GLIBC__ > 2 || __GLIBC_MINOR__ >= 33 )
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+void report_memory( const string& what, size_t entries, size_t bytes ){
+  cout << "  " << left << setw(44) << what << right;
+  if ( bytes == 0 ){
+    cout << "      unknown" << endl;
+  }
+  else {
+    cout << setw(9) << bytes / entries << " bytes per entry" << endl;
+  }
+}
+
+vector<string> make_corpus( size_t size, size_t vocab_size ){
+  /// create a Zipf-like distributed corpus of UTF-8 words, with a mix of
+  /// ASCII and accented words
+  mt19937 gen( 42 );
+  uniform_int_distribution<int> letter( 0, 25 );
+  uniform_int_distribution<int> len( 2, 12 );
+  vector<string> vocab;
+  vocab.reserve( vocab_size );
+  for ( size_t i=0; i < vocab_size; ++i ){
+    string word;
+    int l = len( gen );
+    for ( int j=0; j < l; ++j ){
+      word += char('a' + letter( gen ));
+    }
+    if ( i % 7 == 0 ){
+      word += "é";
+    }
+    else if ( i % 31 == 0 ){
+      word += "e\xCC\x81"; // a decomposed é, which needs normalization
+    }
+    word += to_string( i );  // assure uniqueness
+    vocab.push_back( word );
+  }
+  uniform_real_distribution<double> rank( 0.0, 1.0 );
+  vector<string> corpus;
+  corpus.reserve( size );
+  for ( size_t i=0; i < size; ++i ){
+    size_t r = size_t( pow( double(vocab_size), rank( gen ) ) ) - 1;
+    corpus.push_back( vocab[r] );
+  }
+  return corpus;
+}
+
+void bench_unicodehash( const vector<UnicodeString>& corpus ){
+  cout << "UnicodeHash versus ConcurrentUnicodeHash, "
+       << corpus.size() << " tokens" << endl;
+  {
+    Hash::UnicodeHash uh;
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      uh.hash( w );
+    }
+    report( "UnicodeHash, 1 thread", corpus.size(), sw.seconds() );
+  }
+  {
+    // the memory used, compared to the old layout with a UniInfo object
+    // per string
+    size_t before = heap_in_use();
+    size_t entries = 0;
+    size_t bytes = 0;
+    {
+      Hash::UnicodeHash uh;
+      for ( const auto& w : corpus ){
+	uh.hash( w );
+      }
+      entries = uh.num_of_entries();
+      bytes = heap_in_use() - before;
+    }
+    report_memory( "UnicodeHash, memory", entries, bytes );
+    before = heap_in_use();
+    {
+      vector<Hash::UniInfo*> rev_index;
+      unordered_map<UnicodeString,Hash::UniInfo*,
+		    Hash::UnicodeStringHash> map;
+      for ( const auto& w : corpus ){
+	if ( map.find( w ) == map.end() ){
+	  Hash::UniInfo *info = new Hash::UniInfo( w, rev_index.size() + 1 );
+	  map.insert( { w, info } );
+	  rev_index.push_back( info );
+	}
+      }
+      bytes = heap_in_use() - before;
+      for ( const auto& info : rev_index ){
+	delete info;
+      }
+    }
+    report_memory( "UniInfo per string, memory", entries, bytes );
+  }
+  {
+    const size_t doc_size = 5000;
+    vector<vector<UnicodeString>> docs;
+    for ( size_t pos=0; pos < corpus.size(); pos += doc_size ){
+      docs.emplace_back( corpus.begin() + pos,
+			 corpus.begin() + min( pos + doc_size,
+					       corpus.size() ) );
+    }
+    Hash::UnicodeHash uh;
+    StopWatch sw;
+    vector<unsigned int> ids;
+    for ( const auto& doc : docs ){
+      uh.hash_batch( doc, ids );
+    }
+    report( "UnicodeHash::hash_batch, 1 thread", corpus.size(),
+	    sw.seconds() );
+  }
+  for ( int threads : thread_counts() ){
+    Hash::UnicodeHash uh;
+    StopWatch sw;
+#pragma omp parallel for num_threads(threads) schedule(static,1024)
+    for ( size_t i=0; i < corpus.size(); ++i ){
+#pragma omp critical(bench_hash)
+      {
+	uh.hash( corpus[i] );
+      }
+    }
+    report( "UnicodeHash + critical, " + to_string(threads) + " threads",
+	    corpus.size(), sw.seconds() );
+  }
+  for ( int threads : thread_counts() ){
+    Hash::ConcurrentUnicodeHash uh;
+    StopWatch sw;
+#pragma omp parallel for num_threads(threads) schedule(static,1024)
+    for ( size_t i=0; i < corpus.size(); ++i ){
+      uh.hash( corpus[i] );
+    }
+    report( "ConcurrentUnicodeHash, " + to_string(threads) + " threads",
+	    corpus.size(), sw.seconds() );
+  }
+}
+
+void bench_utf8hash( const vector<string>& corpus ){
+  cout << "UnicodeHash versus UTF8Hash on UTF-8 input, "
+       << corpus.size() << " tokens" << endl;
+  {
+    Hash::UnicodeHash uh;
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      uh.hash( TiCC::UnicodeFromUTF8( w ) );
+    }
+    report( "UnicodeFromUTF8 + UnicodeHash", corpus.size(), sw.seconds() );
+  }
+  {
+    Hash::UnicodeHash uh;
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      uh.hash( UnicodeString::fromUTF8( w ) );
+    }
+    report( "fromUTF8 + UnicodeHash", corpus.size(), sw.seconds() );
+  }
+  {
+    Hash::UTF8Hash uh;
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      uh.hash( w );
+    }
+    report( "UTF8Hash", corpus.size(), sw.seconds() );
+  }
+}
+
+void touch_info( unsigned int *info, void *arg ){
+  // thread safe, as long as arg points to an atomic
+  static_cast<atomic<unsigned long>*>(arg)->fetch_add( *info,
+						       memory_order_relaxed );
+}
+
+struct uint_codec {
+  static string encode( const unsigned int& value ){
+    return string( reinterpret_cast<const char*>(&value), sizeof(value) );
+  }
+  static unsigned int decode( string_view raw ){
+    unsigned int value;
+    memcpy( &value, raw.data(), sizeof(value) );
+    return value;
+  }
+};
+
+void bench_unitrie( const vector<UnicodeString>& corpus ){
+  cout << "UniTrie, linked versus frozen, " << corpus.size()
+       << " lookups" << endl;
+  Tries::UniTrie<unsigned int> trie;
+  {
+    StopWatch sw;
+    for ( size_t i=0; i < corpus.size(); ++i ){
+      trie.Store( corpus[i], new unsigned int( i ) );
+    }
+    report( "UniTrie::Store", corpus.size(), sw.seconds() );
+  }
+  size_t found = 0;
+  {
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      found += ( trie.Retrieve( w ) != NULL );
+    }
+    report( "UniTrie::Retrieve, linked", corpus.size(), sw.seconds() );
+  }
+  atomic<unsigned long> total( 0 );
+  {
+    StopWatch sw;
+    trie.ForEachDo( touch_info, &total );
+    report( "UniTrie::ForEachDo, linked", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    trie.ParallelForEachDo( touch_info, &total, true );
+    report( "UniTrie::ParallelForEachDo, linked", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    trie.freeze();
+    report( "UniTrie::freeze", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      found -= ( trie.Retrieve( w ) != NULL );
+    }
+    report( "UniTrie::Retrieve, frozen", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    trie.ForEachDo( touch_info, &total );
+    report( "UniTrie::ForEachDo, frozen", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    trie.ParallelForEachDo( touch_info, &total, true );
+    report( "UniTrie::ParallelForEachDo, frozen", corpus.size(), sw.seconds() );
+  }
+  if ( found != 0 ){
+    cerr << "frozen UniTrie gives other results!" << endl;
+  }
+  const string snapshot = "/tmp/benchmark.unitrie";
+  {
+    StopWatch sw;
+    trie.save<uint_codec>( snapshot );
+    report( "UniTrie::save", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    Tries::MappedUniTrie<unsigned int, uint_codec> mt( snapshot );
+    double open_secs = sw.seconds();
+    unsigned int value;
+    for ( const auto& w : corpus ){
+      found += mt.Retrieve( w, value );
+    }
+    report( "MappedUniTrie::Retrieve (open: "
+	    + to_string( int(open_secs * 1e6) ) + " us)",
+	    corpus.size(), sw.seconds() );
+  }
+  remove( snapshot.c_str() );
+}
+
+vector<string> make_lines( const vector<string>& corpus, size_t fields ){
+  /// glue the corpus into tab separated lines of \e fields fields
+  vector<string> lines;
+  for ( size_t pos=0; pos < corpus.size(); pos += fields ){
+    string line;
+    for ( size_t i=pos; i < min( pos + fields, corpus.size() ); ++i ){
+      if ( i != pos ){
+	line += "\t";
+      }
+      line += corpus[i];
+    }
+    lines.push_back( line );
+  }
+  return lines;
+}
+
+void bench_split( const vector<string>& corpus ){
+  vector<string> lines = make_lines( corpus, 20 );
+  cout << "splitting " << lines.size() << " lines of 20 fields" << endl;
+  size_t total = 0;
+  {
+    StopWatch sw;
+    vector<string> parts;
+    for ( const auto& line : lines ){
+      total += TiCC::split_at( line, parts, "\t" );
+    }
+    report( "split_at into vector<string>", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    vector<string_view> parts;
+    for ( const auto& line : lines ){
+      total -= TiCC::split_at( line, parts, "\t" );
+    }
+    report( "split_at into vector<string_view>", corpus.size(),
+	    sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      for ( const auto& part : TiCC::StringSplitter( line, "\t" ) ){
+	total += !part.empty();
+      }
+    }
+    report( "StringSplitter", corpus.size(), sw.seconds() );
+  }
+  if ( total != corpus.size() ){
+    cerr << "the split variants give other results!" << endl;
+  }
+}
+
+void bench_stringops( const vector<string>& corpus ){
+  vector<string> lines = make_lines( corpus, 20 );
+  for ( auto& line : lines ){
+    line = "   \t " + line + " \t\r\n";
+  }
+  cout << "string kernels versus plain std:: code, " << lines.size()
+       << " lines" << endl;
+  size_t check = 0;
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      string::size_type b = line.find_first_not_of( " \t\r\n" );
+      string::size_type e = line.find_last_not_of( " \t\r\n" );
+      check += line.substr( b, e-b+1 ).size();
+    }
+    report( "trim, std::find_first_not_of", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      check -= TiCC::trim( line ).size();
+    }
+    report( "TiCC::trim", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      string tmp = line;
+      transform( tmp.begin(), tmp.end(), tmp.begin(),
+		 []( char c ){ return tolower( c ); } );
+      check += tmp.size();
+    }
+    report( "lowercase, std::transform", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      check -= TiCC::lowercase( line ).size();
+    }
+    report( "TiCC::lowercase", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      string::size_type pos = 0;
+      while ( ( pos = line.find_first_of( "\t ", pos ) ) != string::npos ){
+	++check;
+	++pos;
+      }
+    }
+    report( "scan, std::find_first_of", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    vector<string_view> parts;
+    for ( const auto& line : lines ){
+      check -= TiCC::split_exact_at_first_of( line, parts, "\t " ) - 1;
+    }
+    report( "TiCC::split_exact_at_first_of", lines.size(), sw.seconds() );
+  }
+  if ( check != 0 ){
+    cerr << "the string kernels give other results!" << endl;
+  }
+}
+
+template <typename T>
+bool stream_stringTo( const string& str, T& result ){
+  // the old, stream based, stringTo()
+  T tmp;
+  stringstream ss( str );
+  if ( ss >> tmp ){
+    result = tmp;
+    return true;
+  }
+  return false;
+}
+
+void bench_numbers( size_t size ){
+  mt19937 gen( 42 );
+  uniform_int_distribution<int> ints( -1000000, 1000000 );
+  uniform_real_distribution<double> reals( -1000.0, 1000.0 );
+  vector<string> int_strings;
+  vector<string> real_strings;
+  for ( size_t i=0; i < size; ++i ){
+    int_strings.push_back( to_string( ints( gen ) ) );
+    real_strings.push_back( to_string( reals( gen ) ) );
+  }
+  cout << "stringTo(), " << size << " numbers" << endl;
+  long int isum = 0;
+  double dsum1 = 0;
+  double dsum2 = 0;
+  {
+    StopWatch sw;
+    for ( const auto& s : int_strings ){
+      int i = 0;
+      stream_stringTo( s, i );
+      isum += i;
+    }
+    report( "int, stringstream", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& s : int_strings ){
+      int i = 0;
+      TiCC::stringTo( s, i );
+      isum -= i;
+    }
+    report( "int, stringTo", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& s : real_strings ){
+      double d = 0;
+      stream_stringTo( s, d );
+      dsum1 += d;
+    }
+    report( "double, stringstream", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& s : real_strings ){
+      double d = 0;
+      TiCC::stringTo( s, d );
+      dsum2 += d;
+    }
+    report( "double, stringTo", size, sw.seconds() );
+  }
+  size_t fails = 0;
+  {
+    StopWatch sw;
+    for ( const auto& s : int_strings ){
+      // the old stringTo( s, result ) threw and caught on failure
+      try {
+	int i;
+	if ( !stream_stringTo( "x" + s, i ) ){
+	  throw runtime_error( "conversion failed" );
+	}
+      }
+      catch ( ... ){
+	++fails;
+      }
+    }
+    report( "failing int, stringstream + exception", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& s : int_strings ){
+      int i;
+      fails -= !TiCC::stringTo( "x" + s, i );
+    }
+    report( "failing int, stringTo", size, sw.seconds() );
+  }
+  if ( isum != 0 || dsum1 != dsum2 || fails != 0 ){
+    cerr << "stringTo gives other results!" << endl;
+  }
+}
+
+void bench_conversions( const vector<string>& corpus ){
+  cout << "UTF-8 <-> UnicodeString, " << corpus.size() << " tokens" << endl;
+  size_t len1 = 0;
+  size_t len2 = 0;
+  vector<UnicodeString> ucorpus;
+  ucorpus.reserve( corpus.size() );
+  {
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      // what UnicodeFromUTF8 used to do
+      TiCC::UnicodeNormalizer un;
+      len1 += un.normalize( UnicodeString::fromUTF8( w ) ).length();
+    }
+    report( "UnicodeFromUTF8, uncached", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& w : corpus ){
+      len2 += TiCC::UnicodeFromUTF8( w ).length();
+    }
+    report( "UnicodeFromUTF8", corpus.size(), sw.seconds() );
+  }
+  for ( const auto& w : corpus ){
+    ucorpus.push_back( TiCC::UnicodeFromUTF8( w ) );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& us : ucorpus ){
+      TiCC::UnicodeNormalizer un;
+      string s;
+      un.normalize( us ).toUTF8String( s );
+      len1 += s.size();
+    }
+    report( "UnicodeToUTF8, uncached", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& us : ucorpus ){
+      len2 += TiCC::UnicodeToUTF8( us ).size();
+    }
+    report( "UnicodeToUTF8", corpus.size(), sw.seconds() );
+  }
+  if ( len1 != len2 ){
+    cerr << "conversions give other results!" << endl;
+  }
+}
+
+void bench_normalize( const vector<string>& corpus ){
+  vector<string> lines = make_lines( corpus, 20 );
+  string text;
+  for ( const auto& line : lines ){
+    text += line + "\n";
+  }
+  cout << "normalizing " << text.size() << " bytes of UTF-8" << endl;
+  size_t len1 = 0;
+  {
+    StopWatch sw;
+    istringstream is( text );
+    string line;
+    while ( getline( is, line ) ){
+      len1 += TiCC::UnicodeToUTF8( TiCC::UnicodeFromUTF8( line ) ).size() + 1;
+    }
+    report( "line by line", text.size(), sw.seconds() );
+  }
+  TiCC::UnicodeNormalizer un;
+  size_t len2 = 0;
+  {
+    StopWatch sw;
+    istringstream is( text );
+    ostringstream os;
+    un.normalize( is, os );
+    len2 = os.str().size();
+    report( "normalize( istream&, ostream& )", text.size(), sw.seconds() );
+  }
+  for ( int threads : thread_counts() ){
+#ifdef HAVE_OPENMP
+    omp_set_num_threads( threads );
+#endif
+    StopWatch sw;
+    istringstream is( text );
+    ostringstream os;
+    un.normalize_parallel( is, os );
+    if ( os.str().size() != len2 ){
+      len2 = 0;
+    }
+    report( "normalize_parallel, " + to_string(threads) + " threads",
+	    text.size(), sw.seconds() );
+  }
+#ifdef HAVE_OPENMP
+  omp_set_num_threads( thread_counts().back() );
+#endif
+  if ( len1 != len2 ){
+    cerr << "normalize gives other results!" << endl;
+  }
+}
+
+void bench_filter( const vector<string>& corpus ){
+  vector<string> lines = make_lines( corpus, 20 );
+  vector<UnicodeString> ulines;
+  for ( const auto& line : lines ){
+    ulines.push_back( TiCC::UnicodeFromUTF8( line ) );
+  }
+  cout << "filtering " << ulines.size() << " lines" << endl;
+  {
+    StopWatch sw;
+    TiCC::UniFilter filt;
+    for ( int i=0; i < 1000; ++i ){
+      filt.add( "q" + to_string( i ) + "q > Q ;" );
+    }
+    filt.filter( ulines[0] );
+    report( "UniFilter, add 1000 rules", 1000, sw.seconds() );
+  }
+  TiCC::UniFilter filt;
+  filt.init( "é > e ; [:Dash:]+ > '-' ; \\t > ' ' ;", "bench_filter" );
+  vector<UnicodeString> serial;
+  {
+    StopWatch sw;
+    for ( const auto& line : ulines ){
+      serial.push_back( filt.filter( line ) );
+    }
+    report( "UniFilter::filter", ulines.size(), sw.seconds() );
+  }
+  bool same = true;
+  for ( int threads : thread_counts() ){
+#ifdef HAVE_OPENMP
+    omp_set_num_threads( threads );
+#endif
+    vector<UnicodeString> batch = ulines;
+    StopWatch sw;
+    filt.filter_batch( batch );
+    report( "UniFilter::filter_batch, " + to_string(threads) + " threads",
+	    ulines.size(), sw.seconds() );
+    same = same && batch == serial;
+  }
+  serial.clear();
+  {
+    StopWatch sw;
+    for ( const auto& line : ulines ){
+      serial.push_back( TiCC::filter_diacritics( line ) );
+    }
+    report( "filter_diacritics", ulines.size(), sw.seconds() );
+  }
+  for ( int threads : thread_counts() ){
+#ifdef HAVE_OPENMP
+    omp_set_num_threads( threads );
+#endif
+    vector<UnicodeString> batch = ulines;
+    StopWatch sw;
+    TiCC::filter_diacritics_batch( batch );
+    report( "filter_diacritics_batch, " + to_string(threads) + " threads",
+	    ulines.size(), sw.seconds() );
+    same = same && batch == serial;
+  }
+#ifdef HAVE_OPENMP
+  omp_set_num_threads( thread_counts().back() );
+#endif
+  if ( !same ){
+    cerr << "filter_batch gives other results!" << endl;
+  }
+}
+
+void bench_regex( const vector<UnicodeString>& corpus ){
+  cout << "UnicodeRegexMatcher, " << corpus.size() << " tokens" << endl;
+  TiCC::UnicodeRegexMatcher matcher( "^(\\p{L}+)(\\p{N}+)$", "bench" );
+  size_t n1 = 0;
+  size_t n2 = 0;
+  {
+    StopWatch sw;
+    UnicodeString pre;
+    UnicodeString post;
+    for ( const auto& w : corpus ){
+      if ( matcher.match_all( w, pre, post ) ){
+	n1 += matcher.get_match( 1 ).length();
+      }
+    }
+    report( "match_all + get_match", corpus.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    vector<TiCC::UnicodeRegexMatcher::span> spans;
+    TiCC::UnicodeRegexMatcher::span pre;
+    TiCC::UnicodeRegexMatcher::span post;
+    for ( const auto& w : corpus ){
+      if ( matcher.match_offsets( w, spans, pre, post ) ){
+	n2 += spans[1].second - spans[1].first;
+      }
+    }
+    report( "match_offsets", corpus.size(), sw.seconds() );
+  }
+  for ( int threads : thread_counts() ){
+    size_t n3 = 0;
+    StopWatch sw;
+#pragma omp parallel for num_threads(threads) schedule(static,1024) reduction(+:n3)
+    for ( size_t i=0; i < corpus.size(); ++i ){
+      vector<TiCC::UnicodeRegexMatcher::span> spans;
+      TiCC::UnicodeRegexMatcher::span pre;
+      TiCC::UnicodeRegexMatcher::span post;
+      if ( matcher.match_offsets( corpus[i], spans, pre, post ) ){
+	n3 += spans[1].second - spans[1].first;
+      }
+    }
+    report( "match_offsets, " + to_string(threads) + " threads",
+	    corpus.size(), sw.seconds() );
+    if ( n3 != n2 ){
+      n2 = 0;
+    }
+  }
+  vector<UnicodeString> lines;
+  for ( size_t i=0; i + 20 <= corpus.size(); i += 20 ){
+    UnicodeString line;
+    for ( size_t j=i; j < i + 20; ++j ){
+      line += corpus[j] + "  ";
+    }
+    lines.push_back( line );
+  }
+  TiCC::UnicodeRegexMatcher spaces( "\\s+", "spaces" );
+  size_t s1 = 0;
+  size_t s2 = 0;
+  {
+    StopWatch sw;
+    vector<UnicodeString> parts;
+    for ( const auto& line : lines ){
+      s1 += spaces.split( line, parts );
+    }
+    report( "split, UnicodeStrings", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    vector<TiCC::UnicodeRegexMatcher::span> parts;
+    for ( const auto& line : lines ){
+      s2 += spaces.split( line, parts );
+    }
+    report( "split, spans", lines.size(), sw.seconds() );
+  }
+  if ( n1 != n2 || s1 != s2 ){
+    cerr << "UnicodeRegexMatcher gives other results!" << endl;
+  }
+}
+
+void bench_usplit( const vector<UnicodeString>& corpus ){
+  vector<UnicodeString> lines;
+  for ( size_t i=0; i + 20 <= corpus.size(); i += 20 ){
+    UnicodeString line;
+    for ( size_t j=i; j < i + 20; ++j ){
+      line += corpus[j] + (j%2?" ":", ");
+    }
+    lines.push_back( line );
+  }
+  cout << "Unicode split, " << lines.size() << " lines" << endl;
+  const UnicodeString seps = " ,.";
+  size_t n1 = 0;
+  size_t n2 = 0;
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      n1 += TiCC::split_at_first_of( line, seps ).size();
+    }
+    report( "split_at_first_of, UnicodeStrings", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    const TiCC::UnicodeCharSet set( seps );
+    vector<TiCC::UnicodeSpan> spans;
+    for ( const auto& line : lines ){
+      n2 += TiCC::split_at_first_of( line, set, spans );
+    }
+    report( "split_at_first_of, spans", lines.size(), sw.seconds() );
+  }
+  size_t n3 = 0;
+  size_t n4 = 0;
+  {
+    StopWatch sw;
+    for ( const auto& line : lines ){
+      n3 += TiCC::split_at( line, ", " ).size();
+    }
+    report( "split_at, UnicodeStrings", lines.size(), sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    vector<TiCC::UnicodeSpan> spans;
+    for ( const auto& line : lines ){
+      n4 += TiCC::split_at( line, ", ", spans );
+    }
+    report( "split_at, spans", lines.size(), sw.seconds() );
+  }
+  if ( n1 != n2 || n3 != n4 ){
+    cerr << "Unicode split gives other results!" << endl;
+  }
+}
+
+void bench_linereader( const string& what, const string& text,
+		       size_t num_lines ){
+  size_t len1 = 0;
+  size_t len2 = 0;
+  {
+    StopWatch sw;
+    istringstream is( text );
+    UnicodeString line;
+    while ( TiCC::getline( is, line ) ){
+      len1 += line.length();
+    }
+    report( "TiCC::getline, " + what, num_lines, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    istringstream is( text );
+    TiCC::UnicodeLineReader reader( is );
+    UnicodeString line;
+    while ( reader.getline( line ) ){
+      len2 += line.length();
+    }
+    report( "UnicodeLineReader, " + what, num_lines, sw.seconds() );
+  }
+  if ( len1 != len2 ){
+    cerr << "UnicodeLineReader gives other results!" << endl;
+  }
+}
+
+void bench_linereader( const vector<string>& corpus ){
+  vector<string> lines = make_lines( corpus, 20 );
+  string text;
+  string nfc_text;
+  for ( const auto& line : lines ){
+    text += line + "\n";
+    nfc_text += TiCC::UnicodeToUTF8( TiCC::UnicodeFromUTF8( line ) ) + "\n";
+  }
+  cout << "reading " << lines.size() << " UTF-8 lines" << endl;
+  bench_linereader( "mixed", text, lines.size() );
+  bench_linereader( "NFC", nfc_text, lines.size() );
+}
+
+template <typename T>
+string stream_toString( const T& val ){
+  // how toString() used to work
+  stringstream ss;
+  ss << val;
+  return ss.str();
+}
+
+void bench_formatting( size_t size ){
+  mt19937 gen( 42 );
+  uniform_int_distribution<int> ints( -1000000, 1000000 );
+  uniform_real_distribution<double> reals( -1000.0, 1000.0 );
+  vector<int> int_values;
+  vector<double> real_values;
+  for ( size_t i=0; i < size; ++i ){
+    int_values.push_back( ints( gen ) );
+    real_values.push_back( reals( gen ) );
+  }
+  cout << "toString(), " << size << " numbers" << endl;
+  size_t ilen1 = 0;
+  size_t ilen2 = 0;
+  size_t dlen1 = 0;
+  size_t dlen2 = 0;
+  size_t alen = 0;
+  size_t jlen1 = 0;
+  size_t jlen2 = 0;
+  {
+    StopWatch sw;
+    for ( const auto& i : int_values ){
+      ilen1 += stream_toString( i ).size();
+    }
+    report( "int, stringstream", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& i : int_values ){
+      ilen2 += TiCC::toString( i ).size();
+    }
+    report( "int, toString", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& d : real_values ){
+      dlen1 += stream_toString( d ).size();
+    }
+    report( "double, stringstream", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( const auto& d : real_values ){
+      dlen2 += TiCC::toString( d ).size();
+    }
+    report( "double, toString", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    string out;
+    for ( const auto& d : real_values ){
+      TiCC::append_to_string( out, d );
+      out += ' ';
+    }
+    alen = out.size() - size;
+    report( "double, append_to_string", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    UnicodeString result;
+    for ( const auto& d : real_values ){
+      if ( &d != &real_values.front() ){
+	result += " ";
+      }
+      // the old join<double>()
+      result += TiCC::UnicodeFromUTF8( stream_toString( d ) );
+    }
+    jlen1 = result.length();
+    report( "join<double>, stringstream", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    UnicodeString result = TiCC::join( real_values );
+    jlen2 = result.length();
+    report( "join<double>", size, sw.seconds() );
+  }
+  if ( ilen1 != ilen2 || dlen1 != dlen2 || alen != dlen1
+       || jlen1 != jlen2 ){
+    cerr << "toString gives other results!" << endl;
+  }
+}
+
+void bench_logging( size_t size ){
+  size_t records = size / 10;
+  cout << "LogStream, " << records << " records" << endl;
+  ofstream out( "/dev/null" );
+  for ( int async = 0; async < 2; ++async ){
+    TiCC::LogStream ls( out );
+    ls.set_stamp( StampTime );
+    if ( async ){
+      ls.set_async_mode();
+    }
+    for ( int threads : thread_counts() ){
+      StopWatch sw;
+#pragma omp parallel for num_threads(threads) schedule(static,64)
+      for ( size_t i=0; i < records; ++i ){
+	*TiCC::Log( ls ) << "a log record " << i << endl;
+	*TiCC::Dbg( ls ) << "a suppressed record " << i << endl;
+      }
+      ls.async_flush();
+      report( string( async ? "async" : "locking" ) + ", "
+	      + to_string(threads) + " threads",
+	      records, sw.seconds() );
+    }
+  }
+  const vector<pair<LogFormat,string>> formats = {
+    { LogText, "text" }, { LogJson, "json" },
+    { LogBinary, "binary" }, { LogRingOnly, "ring only" } };
+  for ( const auto& format : formats ){
+    TiCC::LogStream ls( out );
+    ls.set_format( format.first );
+    StopWatch sw;
+    for ( size_t i=0; i < records; ++i ){
+      *TiCC::Log( ls ) << "a log record " << i << endl;
+    }
+    report( "format " + format.second, records, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    size_t len = 0;
+    for ( size_t i=0; i < size; ++i ){
+      len += time_stamp().size();
+    }
+    report( "time_stamp", size, sw.seconds() );
+    if ( len != 20 * size ){
+      cerr << "time_stamp gives other results!" << endl;
+    }
+  }
+  TiCC::LogStream ls( out );
+  {
+    StopWatch sw;
+    for ( size_t i=0; i < size; ++i ){
+      *TiCC::Dbg( ls ) << "a suppressed record " << i << endl;
+    }
+    report( "suppressed Dbg", size, sw.seconds() );
+  }
+  {
+    StopWatch sw;
+    for ( size_t i=0; i < size; ++i ){
+      TICC_DBG( ls ) << "a suppressed record " << i << endl;
+    }
+    report( "suppressed TICC_DBG", size, sw.seconds() );
+  }
+}
+
+int main( int argc, char *argv[] ){
+  TiCC::CL_Options opts( "", "size:" );
+  opts.init( argc, argv );
+  size_t size = 2000000;
+  opts.extract( "size", size );
+  vector<string> suites = opts.getMassOpts();
+  auto wanted = [&]( const string& suite ){
+    return suites.empty()
+    || find( suites.begin(), suites.end(), suite ) != suites.end();
+  };
+  vector<string> corpus = make_corpus( size, size / 20 );
+  vector<UnicodeString> ucorpus;
+  ucorpus.reserve( corpus.size() );
+  for ( const auto& w : corpus ){
+    ucorpus.push_back( UnicodeString::fromUTF8( w ) );
+  }
+  cout << "running with at most " << max_threads() << " threads" << endl;
+  if ( wanted( "unicodehash" ) ){
+    bench_unicodehash( ucorpus );
+  }
+  if ( wanted( "utf8hash" ) ){
+    bench_utf8hash( corpus );
+  }
+  if ( wanted( "unitrie" ) ){
+    bench_unitrie( ucorpus );
+  }
+  if ( wanted( "split" ) ){
+    bench_split( corpus );
+  }
+  if ( wanted( "stringops" ) ){
+    bench_stringops( corpus );
+  }
+  if ( wanted( "numbers" ) ){
+    bench_numbers( size );
+  }
+  if ( wanted( "formatting" ) ){
+    bench_formatting( size );
+  }
+  if ( wanted( "conversions" ) ){
+    bench_conversions( corpus );
+  }
+  if ( wanted( "normalize" ) ){
+    bench_normalize( corpus );
+  }
+  if ( wanted( "filter" ) ){
+    bench_filter( corpus );
+  }
+  if ( wanted( "regex" ) ){
+    bench_regex( ucorpus );
+  }
+  if ( wanted( "usplit" ) ){
+    bench_usplit( ucorpus );
+  }
+  if ( wanted( "logging" ) ){
+    bench_logging( size );
+  }
+  if ( wanted( "linereader" ) ){
+    bench_linereader( corpus );
+  }
+}
@@ -30,10 +30,18 @@
 #include <iostream>
 #include <sstream>
 #include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <sys/wait.h>
 #include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <limits>
 
 #include "ticcutils/StringOps.h"
 #include "ticcutils/UniHash.h"
+#include "ticcutils/UniTrie.h"
 #include "ticcutils/PrettyPrint.h"
 #include "ticcutils/zipper.h"
 #include "ticcutils/Version.h"
@@ -462,6 +470,49 @@ void test_pad(){
   assertEqual( u_res, "    τ" );
 }
 
+void test_inplace(){
+  vector<string> vals = { " aha ", "", " \r ", "A", "AHA\r\n",
+			  "\t lang genoeg om de vector code te gebruiken \t\n" };
+  bool same = true;
+  for ( const auto& val : vals ){
+    string tmp = val;
+    trim_inplace( tmp );
+    same &= ( tmp == trim( val ) );
+    tmp = val;
+    trim_front_inplace( tmp );
+    same &= ( tmp == trim_front( val ) );
+    tmp = val;
+    trim_back_inplace( tmp );
+    same &= ( tmp == trim_back( val ) );
+    tmp = val;
+    trim_inplace( tmp, "a " );
+    same &= ( tmp == trim( val, "a " ) );
+    tmp = val;
+    pad_inplace( tmp, 10, 'x' );
+    same &= ( tmp == pad( val, 10, 'x' ) );
+  }
+  assertTrue( same );
+  string out = "een heel lange string, die niet opnieuw gealloceerd wordt";
+  const char *buffer = out.data();
+  lowercase_into( "AHA Één", out );
+  assertEqual( out, "aha Één" );
+  uppercase_into( "aha", out );
+  assertEqual( out, "AHA" );
+  vector<string> parts = { "De", "kat", "krabt" };
+  join_into( out, parts );
+  assertEqual( out, "De kat krabt" );
+  assertTrue( out.data() == buffer );
+  join_into( out, parts, "--" );
+  assertEqual( out, join( parts, "--" ) );
+  vector<string_view> views;
+  split( "De kat  krabt", views );
+  join_into( out, views, "\t" );
+  assertEqual( out, "De\tkat\tkrabt" );
+  join_into( out, vector<string>() );
+  assertEqual( out, "" );
+  assertEqual( join( vector<string>( 1, "een" ) ), "een" );
+}
+
 void test_match_front(){
   assertTrue( match_front("janklaassenenkatrien", "janklaassen" ) );
   assertFalse( match_front("janklaassenenkatrien", "anklaassen" ) );
@@ -581,6 +632,121 @@ void test_split_at_first_exact(){
   assertEqual( res[9], "" );
 }
 
+void test_split_view(){
+  string line = "De kat krabt de krullen\n van de   trap.";
+  vector<string_view> res;
+  size_t cnt = split( line, res );
+  assertEqual( cnt, 8 );
+  assertEqual( res[5], "van" );
+  assertTrue( res[5].data() == line.data() + 25 ); // no copy
+  cnt = split( line, res, 3 );
+  assertEqual( cnt, 3 );
+  assertEqual( res[2], "krabt de krullen\n van de   trap." );
+  cnt = split_exact( "1 2  4    8  10", res );
+  assertEqual( cnt, 10 );
+  assertEqual( res[5], "" );
+  cnt = split_exact_at( "1/2//4////8//10", res, "/" );
+  assertEqual( cnt, 10 );
+  cnt = split_at( "Derarekatrarekrabtrarederarekrullen", res, "rare", 4 );
+  assertEqual( cnt, 4 );
+  assertEqual( res[3], "derarekrullen" );
+  assertThrow( split_at( line, res, "" ), runtime_error );
+  // the same results as the string versions, for all limits
+  vector<string> lines = { line, "", " ", "a", " a b ", "a  b\t\tc ",
+			   "De.kat,krabt:de;krullen?van.,;.;de!trap." };
+  bool same = true;
+  for ( const auto& l : lines ){
+    for ( size_t num=0; num < 6; ++num ){
+      vector<string> v1 = split_at_first_of( l, " .,?!:;", num );
+      split_at_first_of( l, res, " .,?!:;", num );
+      same &= ( v1 == vector<string>( res.begin(), res.end() ) );
+      v1 = split_at( l, "  ", num );
+      split_at( l, res, "  ", num );
+      same &= ( v1 == vector<string>( res.begin(), res.end() ) );
+    }
+    vector<string> v2;
+    split_exact_at_first_of( l, v2, " ," );
+    split_exact_at_first_of( l, res, " ," );
+    same &= ( v2 == vector<string>( res.begin(), res.end() ) );
+    split_exact_at( l, v2, "  " );
+    vector<string> v3;
+    for ( const auto& part : StringSplitter( l, "  ",
+					     StringSplitter::AT, true ) ){
+      v3.emplace_back( part );
+    }
+    same &= ( v2 == v3 );
+    split( l, v2 );
+    v3.clear();
+    for ( const auto& part : StringSplitter( l ) ){
+      v3.emplace_back( part );
+    }
+    same &= ( v2 == v3 );
+  }
+  assertTrue( same );
+  StringSplitter sp( "a\tb\t\tc", "\t", StringSplitter::AT_FIRST_OF, true );
+  auto it = sp.begin();
+  assertEqual( *it++, "a" );
+  assertEqual( *it, "b" );
+  ++it;
+  assertEqual( *it, "" );
+  assertEqual( *++it, "c" );
+  assertTrue( ++it == sp.end() );
+}
+
+void test_string_kernels(){
+  // the (vectorized) string kernels must give the same results as the
+  // plain std:: functions, for any length and content
+  const string pool = "aZ Ii\t\n\r.,xyz\xC3\xA9\x80\xFF@[`{";
+  const string ws = " \t\r\n";
+  srand( 42 );
+  bool same = true;
+  for ( int n=0; n < 2000; ++n ){
+    string s;
+    size_t len = rand() % 100;
+    bool padded = rand() % 2;
+    for ( size_t i=0; i < len; ++i ){
+      if ( padded && ( i < 20 || i + 20 > len ) ){
+	s += ws[rand() % ws.size()];
+      }
+      else {
+	s += pool[rand() % pool.size()];
+      }
+    }
+    size_t b = s.find_first_not_of( ws );
+    size_t e = s.find_last_not_of( ws );
+    string ref = ( b == string::npos ) ? "" : s.substr( b, e-b+1 );
+    same &= ( trim( s ) == ref );
+    same &= ( trim_front( s ) == ( b == string::npos ? "" : s.substr( b ) ) );
+    same &= ( trim_back( s ) == ( e == string::npos ? "" : s.substr( 0, e+1 ) ) );
+    string low = s;
+    string upp = s;
+    for ( auto& c : low ){
+      c = tolower( c );
+    }
+    for ( auto& c : upp ){
+      c = toupper( c );
+    }
+    same &= ( lowercase( s ) == low );
+    same &= ( uppercase( s ) == upp );
+    vector<string> parts;
+    string part;
+    for ( const auto& c : s ){
+      if ( string( " .,@" ).find( c ) != string::npos ){
+	parts.push_back( part );
+	part.clear();
+      }
+      else {
+	part += c;
+      }
+    }
+    parts.push_back( part );
+    vector<string> res;
+    split_exact_at_first_of( s, res, " .,@" );
+    same &= ( res == parts );
+  }
+  assertTrue( same );
+}
+
 void test_to_upper(){
   string line = "Een CamelCapped Zin.";
   to_upper( line );
@@ -661,6 +827,439 @@ void test_unicodehash(){
   assertEqual( index, 4 );
   assertEqual( uh.num_of_entries(), 4 );
   assertEqual( uh.reverse_lookup( 3 ), "禁禂" );
+  UnicodeString long_one( 100000, U'禁', 100000 ); // needs its own block
+  index = uh.hash( long_one );
+  assertEqual( index, 5 );
+  for ( int i=0; i < 20000; ++i ){
+    // fill more then one arena block
+    uh.hash( toUnicodeString( i ) );
+  }
+  assertEqual( uh.lookup( long_one ), 5 );
+  assertEqual( uh.reverse_lookup( 5 ), long_one );
+  assertEqual( uh.reverse_lookup( uh.lookup( "12345" ) ), "12345" );
+  assertEqual( uh.reverse_lookup( 1 ), "appel" );
+  // the reference stays valid when the hash grows, copies are real copies
+  const UnicodeString& ref = uh.reverse_lookup( 1 );
+  UnicodeString copy = uh.reverse_lookup( 1 );
+  vector<UnicodeString> copies;
+  copies.push_back( uh.reverse_lookup( 1 ) );
+  for ( int i=0; i < 20000; ++i ){
+    uh.hash( "x" + toUnicodeString( i ) );
+  }
+  assertTrue( &ref == &uh.reverse_lookup( 1 ) );
+  assertEqual( ref, "appel" );
+  assertTrue( copy.getBuffer() != ref.getBuffer() );
+  assertTrue( copies[0].getBuffer() != ref.getBuffer() );
+  copy.append( "moes" );
+  assertEqual( ref, "appel" );
+}
+
+void test_unicodehash_batch(){
+  Hash::UnicodeHash uh;
+  uh.hash( "appel" );
+  vector<UnicodeString> batch = { "peer", "appel", "ἀντιϰειμένου", "peer",
+				  "ἀντιϰειμένου", "Ünïcödé" };
+  vector<unsigned int> ids;
+  uh.hash_batch( batch, ids );
+  assertEqual( ids.size(), batch.size() );
+  assertEqual( ids[0], 2 );
+  assertEqual( ids[1], 1 );
+  assertEqual( ids[2], 3 );
+  assertEqual( ids[3], 2 );
+  assertEqual( ids[4], 3 ); // the same, after normalization
+  assertEqual( ids[5], 4 );
+  assertEqual( uh.num_of_entries(), 4 );
+  batch.push_back( "pruim" );
+  uh.lookup_batch( batch, ids );
+  assertEqual( ids.size(), batch.size() );
+  assertEqual( ids[4], 3 );
+  assertEqual( ids[6], 0 );
+  assertEqual( uh.num_of_entries(), 4 );
+}
+
+void test_utf8hash(){
+  Hash::UTF8Hash uh;
+  size_t index = uh.hash( "appel" );
+  assertEqual( index, 1 );
+  index = uh.hash( "peer" );
+  assertEqual( index, 2 );
+  index = uh.hash( "禁禂" );
+  assertEqual( index, 3 );
+  index = uh.hash( "peer" );
+  assertEqual( index, 2 );
+  string greek1 = "ἀντιϰειμένου";
+  string greek2 = "ἀντιϰειμένου"; //different normalizations!
+  assertFalse( greek1 == greek2 );
+  index = uh.hash( greek1 );
+  assertEqual( index, 4 );
+  index = uh.hash( greek2 );
+  assertEqual( index, 4 );
+  assertEqual( uh.lookup( "Ünïcödé" ), 0 );
+  assertEqual( uh.num_of_entries(), 4 );
+  assertEqual( uh.reverse_lookup( 3 ), "禁禂" );
+  // invalid UTF-8 is treated like UnicodeFromUTF8() does
+  index = uh.hash( "a\xFF\xC0z" );
+  assertEqual( uh.reverse_lookup( index ),
+	       UnicodeToUTF8( UnicodeFromUTF8( "a\xFF\xC0z" ) ) );
+  // the same ID's as an UnicodeHash
+  Hash::UTF8Hash uh1;
+  Hash::UnicodeHash uh2;
+  vector<string> words = { "appel", "peer", "禁禂", greek2, greek1, "café",
+			   "cafe\xCC\x81", "Ünïcödé", "appel" };
+  bool same = true;
+  for ( const auto& w : words ){
+    unsigned int id = uh2.hash( UnicodeFromUTF8( w ) );
+    same &= ( uh1.hash( w ) == id );
+    same &= ( UnicodeFromUTF8( string( uh1.reverse_lookup( id ) ) )
+	      == uh2.reverse_lookup( id ) );
+  }
+  assertTrue( same );
+  for ( int i=0; i < 40000; ++i ){
+    // fill more then one arena block
+    uh.hash( toString( i ) );
+  }
+  assertEqual( uh.reverse_lookup( uh.lookup( "12345" ) ), "12345" );
+  assertEqual( uh.reverse_lookup( 1 ), "appel" );
+}
+
+template <typename T>
+void corrupt_snapshot( const string& from, size_t pos, T value ){
+  // copy a snapshot to /tmp/unihash.bad, overwriting the value at pos
+  ifstream is( from, ios::binary );
+  string buf( (istreambuf_iterator<char>( is )), istreambuf_iterator<char>() );
+  buf.replace( pos, sizeof(T), reinterpret_cast<const char*>(&value),
+	       sizeof(T) );
+  ofstream os( "/tmp/unihash.bad", ios::binary );
+  os << buf;
+}
+
+void test_unicodehash_snapshot(){
+  Hash::UnicodeHash uh;
+  uh.hash( "appel" );
+  uh.hash( "peer" );
+  uh.hash( "禁禂" );
+  uh.hash( "" );
+  for ( int i=0; i < 1000; ++i ){
+    uh.hash( toUnicodeString( i ) );
+  }
+  assertNoThrow( uh.save( "/tmp/unihash.snap" ) );
+  Hash::MappedUnicodeHash mh( "/tmp/unihash.snap" );
+  assertEqual( mh.num_of_entries(), uh.num_of_entries() );
+  assertEqual( mh.lookup( "peer" ), 2 );
+  assertEqual( mh.lookup( "" ), 4 );
+  assertEqual( mh.lookup( "pruim" ), 0 );
+  assertEqual( mh.reverse_lookup( 3 ), "禁禂" );
+  Hash::UniView view = mh.reverse_view( 3 );
+  assertEqual( UnicodeString( view.data(), view.size() ), "禁禂" );
+  assertEqual( mh.lookup( "999" ), uh.lookup( "999" ) );
+  UnicodeString greek1 = "ἀντιϰειμένου";
+  UnicodeString greek2 = "ἀντιϰειμένου"; //different normalizations!
+  uh.hash( greek1 );
+  uh.save( "/tmp/unihash.snap" );
+  Hash::UnicodeHash uh2;
+  assertNoThrow( uh2.load( "/tmp/unihash.snap" ) );
+  assertEqual( uh2.num_of_entries(), uh.num_of_entries() );
+  assertEqual( uh2.lookup( greek2 ), uh.lookup( greek1 ) );
+  assertEqual( uh2.hash( "nieuw" ), uh.num_of_entries() + 1 );
+  assertThrow( uh2.load( "/tmp/unihash.snap" ), logic_error );
+  {
+    ofstream bad( "/tmp/unihash.bad" );
+    bad << "this is no snapshot, but it is long enough to look like one";
+  }
+  assertThrow( Hash::MappedUnicodeHash bad( "/tmp/unihash.bad" ), runtime_error );
+  // header: magic[8], byte_order, version, num_entries, table_size,
+  // data_length, followed by the offsets and the table
+  const size_t num_pos = 16;
+  const size_t table_size_pos = 24;
+  const size_t offsets_pos = 40;
+  const uint64_t entries = uh.num_of_entries();
+  const size_t table_pos = offsets_pos + (entries + 2) * sizeof(uint64_t);
+  corrupt_snapshot( "/tmp/unihash.snap", table_size_pos, uint64_t(1) << 62 );
+  assertThrow( Hash::MappedUnicodeHash bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unihash.snap", num_pos, uint64_t(1) << 61 );
+  assertThrow( Hash::MappedUnicodeHash bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unihash.snap", offsets_pos + sizeof(uint64_t),
+		    uint64_t(1) << 40 );
+  assertThrow( Hash::MappedUnicodeHash bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unihash.snap", table_pos,
+		    uint32_t( entries + 1 ) );
+  assertThrow( Hash::MappedUnicodeHash bad( "/tmp/unihash.bad" ), runtime_error );
+  {
+    // a table without an empty slot would make lookup() loop forever
+    Hash::UnicodeHash small;
+    small.hash( "appel" );
+    small.save( "/tmp/unihash.small" );
+  }
+  ifstream is( "/tmp/unihash.small", ios::binary );
+  string buf( (istreambuf_iterator<char>( is )), istreambuf_iterator<char>() );
+  const uint32_t one = 1;
+  for ( size_t i=0; i < 8; ++i ){
+    buf.replace( offsets_pos + 3 * sizeof(uint64_t) + i * sizeof(uint32_t),
+		 sizeof(uint32_t), reinterpret_cast<const char*>(&one),
+		 sizeof(uint32_t) );
+  }
+  {
+    ofstream os( "/tmp/unihash.bad", ios::binary );
+    os << buf;
+  }
+  assertThrow( Hash::MappedUnicodeHash bad( "/tmp/unihash.bad" ), runtime_error );
+}
+
+void test_concurrent_unicodehash(){
+  Hash::ConcurrentUnicodeHash uh;
+  size_t index = uh.hash( "appel" );
+  assertEqual( index, 1 );
+  index = uh.hash( "peer" );
+  assertEqual( index, 2 );
+  UnicodeString greek1 = "ἀντιϰειμένου";
+  UnicodeString greek2 = "ἀντιϰειμένου"; //different normalizations!
+  index = uh.hash( greek1 );
+  assertEqual( index, 3 );
+  index = uh.hash( greek2 );
+  assertEqual( index, 3 );
+  assertEqual( uh.lookup( "peer" ), 2 );
+  assertEqual( uh.lookup( "pruim" ), 0 );
+  assertEqual( uh.reverse_lookup( 1 ), "appel" );
+  Hash::ConcurrentUnicodeHash uh2( 4 );
+  const int words = 5000;
+#pragma omp parallel for
+  for ( int i=0; i < 4*words; ++i ){
+    // every word is hashed 4 times, by whatever thread comes along
+    uh2.hash( toUnicodeString( i % words ) );
+  }
+  assertEqual( uh2.num_of_entries(), words );
+  bool dense = true;
+  for ( int id=1; id <= words; ++id ){
+    dense &= ( uh2.lookup( uh2.reverse_lookup( id ) ) == (unsigned)id );
+  }
+  assertTrue( dense );
+}
+
+struct trie_info {
+  explicit trie_info( int v ): value(v){};
+  int value;
+};
+
+ostream& operator<<( ostream& os, const trie_info *info ){
+  return os << info->value;
+}
+
+void sum_info( trie_info *info, void *arg ){
+  *static_cast<int*>(arg) = 10 * *static_cast<int*>(arg) + info->value;
+}
+
+void collect_prefix( trie_info *info, int32_t len, void *arg ){
+  *static_cast<string*>(arg) += to_string( info->value ) + ":"
+    + to_string( len ) + " ";
+}
+
+void collect_hit( trie_info *info, int32_t start, int32_t len, void *arg ){
+  *static_cast<string*>(arg) += to_string( info->value ) + ":"
+    + to_string( start ) + ":" + to_string( len ) + " ";
+}
+
+void add_info( trie_info *info, void *arg ){
+  // thread safe
+  static_cast<atomic<int>*>(arg)->fetch_add( info->value );
+}
+
+void count_info( trie_info *info ){
+  // NOT thread safe
+  static int count = 0;
+  info->value = ++count;
+}
+
+struct trie_info_codec {
+  static string encode( const trie_info& info ){
+    return to_string( info.value );
+  }
+  static trie_info decode( string_view raw ){
+    return trie_info( stringTo<int>( string( raw ) ) );
+  }
+};
+
+void test_unitrie_snapshot(){
+  Tries::UniTrie<trie_info> trie;
+  vector<UnicodeString> words = { "appel", "app", "peer", "禁禂", "禁",
+				  "𝄞muziek", "apen" };
+  for ( size_t i=0; i < words.size(); ++i ){
+    trie.Store( words[i], new trie_info( i+1 ) );
+  }
+  assertThrow( trie.save<trie_info_codec>( "/tmp/unitrie.snap" ),
+	       logic_error );
+  trie.freeze();
+  assertNoThrow( trie.save<trie_info_codec>( "/tmp/unitrie.snap" ) );
+  Tries::MappedUniTrie<trie_info,trie_info_codec> mt( "/tmp/unitrie.snap" );
+  assertEqual( mt.num_of_entries(), words.size() );
+  bool same = true;
+  for ( size_t i=0; i < words.size(); ++i ){
+    trie_info info( 0 );
+    same &= mt.Retrieve( words[i], info );
+    same &= ( info.value == int(i+1) );
+  }
+  assertTrue( same );
+  trie_info info( 0 );
+  assertFalse( mt.Retrieve( "ap", info ) );
+  assertFalse( mt.Retrieve( "appels", info ) );
+  assertFalse( mt.Retrieve( "", info ) );
+  string_view raw;
+  assertTrue( mt.RetrieveRaw( "𝄞muziek", raw ) );
+  assertEqual( string( raw ), "6" );
+  Tries::UniTrie<trie_info> empty;
+  empty.freeze();
+  empty.save<trie_info_codec>( "/tmp/unitrie.snap" );
+  Tries::MappedUniTrie<trie_info,trie_info_codec> me( "/tmp/unitrie.snap" );
+  assertEqual( me.num_of_entries(), 0 );
+  assertFalse( me.Retrieve( "appel", info ) );
+  {
+    ofstream bad( "/tmp/unitrie.bad" );
+    bad << "this is no snapshot, but it is long enough to look like one";
+  }
+  typedef Tries::MappedUniTrie<trie_info,trie_info_codec> mapped_trie;
+  assertThrow( mapped_trie bad( "/tmp/unitrie.bad" ), runtime_error );
+  // header: magic[8], byte_order, version, num_nodes, num_entries,
+  // data_length, followed by the nodes and the labels
+  trie.save<trie_info_codec>( "/tmp/unitrie.snap" );
+  uint64_t num_nodes = 0;
+  {
+    ifstream is( "/tmp/unitrie.snap", ios::binary );
+    is.seekg( 16 );
+    is.read( reinterpret_cast<char*>(&num_nodes), sizeof(num_nodes) );
+  }
+  const size_t num_pos = 16;
+  const size_t entries_pos = 24;
+  const size_t nodes_pos = 40;
+  const size_t node_size = 24; // first_child, num_children, info start/size
+  const size_t labels_pos = nodes_pos + num_nodes * node_size;
+  corrupt_snapshot( "/tmp/unitrie.snap", num_pos, uint64_t(1) << 61 );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unitrie.snap", entries_pos,
+		    uint64_t( words.size() + 1 ) );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  // the root's children must come after it, and exist
+  corrupt_snapshot( "/tmp/unitrie.snap", nodes_pos, uint32_t(0) );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unitrie.snap", nodes_pos + 4,
+		    uint32_t( num_nodes ) );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  // an Info outside the data, or one too many
+  corrupt_snapshot( "/tmp/unitrie.snap", nodes_pos + 8, uint64_t(0) );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unitrie.snap", nodes_pos + 3 * node_size + 16,
+		    uint64_t(1) << 40 ); // the Info of '禁'
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  // the labels of the root's children: 'a', 'p', '禁' and '𝄞'
+  corrupt_snapshot( "/tmp/unitrie.snap", labels_pos + 4, int32_t(0x110000) );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unitrie.snap", labels_pos + 8, int32_t('a') );
+  assertThrow( mapped_trie bad( "/tmp/unihash.bad" ), runtime_error );
+  corrupt_snapshot( "/tmp/unitrie.snap", labels_pos + 4, int32_t('b') );
+  mapped_trie good( "/tmp/unihash.bad" );
+  assertEqual( good.num_of_entries(), words.size() );
+}
+
+void test_parallel_unitrie(){
+  Tries::UniTrie<trie_info> trie;
+  const int words = 5000;
+  for ( int i=1; i <= words; ++i ){
+    trie.Store( toUnicodeString( i ) + "_x", new trie_info( i ) );
+  }
+  trie.Store( "", new trie_info( 0 ) );
+  const int expect = words * (words+1) / 2;
+  atomic<int> sum( 0 );
+  trie.ParallelForEachDo( add_info, &sum, true );
+  assertEqual( sum.load(), expect );
+  sum = 0;
+  trie.ParallelForEachDo( add_info, &sum );
+  assertEqual( sum.load(), expect );
+  trie.ParallelForEachDo( count_info );
+  trie.freeze();
+  sum = 0;
+  trie.ParallelForEachDo( add_info, &sum, true );
+  // count_info has renumbered the entries 1 to words+1
+  assertEqual( sum.load(), expect + words + 1 );
+  // a deep trie
+  Tries::UniTrie<trie_info> deep;
+  UnicodeString long_one( 200000, U'x', 200000 );
+  deep.Store( long_one, new trie_info( 1 ) );
+  sum = 0;
+  deep.ForEachDo( add_info, &sum );
+  assertEqual( sum.load(), 1 );
+}
+
+void test_unitrie(){
+  Tries::UniTrie<trie_info> trie;
+  vector<UnicodeString> words = { "appel", "app", "peer", "禁禂", "禁",
+				  "𝄞muziek", "apen" };
+  for ( size_t i=0; i < words.size(); ++i ){
+    trie.Store( words[i], new trie_info( i+1 ) );
+  }
+  // a double is ignored
+  trie_info *dup = trie.Store( "peer", new trie_info( 9 ) );
+  assertEqual( dup->value, 3 );
+  int order = 0;
+  trie.ForEachDo( sum_info, &order );
+  stringstream before;
+  before << &trie;
+  // longer words first, then the Info of the node itself
+  assertEqual( before.str(), "7\n1\n2\n3\n4\n5\n6\n" );
+  int32_t len = 0;
+  trie_info *info = trie.longest_prefix( "appelmoes", 0, len );
+  assertTrue( info != NULL );
+  assertEqual( info->value, 1 );
+  assertEqual( len, 5 );
+  string prefixes;
+  trie.all_prefixes( "een appelmoes", 4, collect_prefix, &prefixes );
+  assertEqual( prefixes, "2:3 1:5 " );
+  UnicodeString text = "een appelpeer en 禁禂 𝄞muziek";
+  assertThrow( trie.find_all( text, collect_hit, &prefixes ), logic_error );
+  assertFalse( trie.frozen() );
+  trie.freeze();
+  assertTrue( trie.frozen() );
+  for ( size_t i=0; i < words.size(); ++i ){
+    trie_info *info = trie.Retrieve( words[i] );
+    assertTrue( info != NULL );
+    assertEqual( info->value, int(i+1) );
+  }
+  assertTrue( trie.Retrieve( "ap" ) == NULL );
+  assertTrue( trie.Retrieve( "appels" ) == NULL );
+  assertTrue( trie.Retrieve( "𝄞" ) == NULL );
+  assertTrue( trie.Retrieve( "" ) == NULL );
+  info = trie.longest_prefix( "appelmoes", 0, len );
+  assertTrue( info != NULL );
+  assertEqual( len, 5 );
+  assertTrue( trie.longest_prefix( "appelmoes", 1, len ) == NULL );
+  assertEqual( len, 0 );
+  info = trie.longest_prefix( text, 20, len );
+  assertEqual( len, 8 );
+  prefixes.clear();
+  trie.all_prefixes( "een appelmoes", 4, collect_prefix, &prefixes );
+  assertEqual( prefixes, "2:3 1:5 " );
+  string hits;
+  trie.find_all( text, collect_hit, &hits );
+  assertEqual( hits, "2:4:3 1:4:5 3:9:4 5:17:1 4:17:2 6:20:8 " );
+  int frozen_order = 0;
+  trie.ForEachDo( sum_info, &frozen_order );
+  assertEqual( frozen_order, order );
+  stringstream after;
+  after << &trie;
+  assertEqual( after.str(), before.str() );
+  assertThrow( trie.Store( "pruim", new trie_info( 8 ) ), logic_error );
+  Tries::UniTrie<trie_info> empty;
+  empty.freeze();
+  assertTrue( empty.Retrieve( "appel" ) == NULL );
+  hits.clear();
+  empty.find_all( text, collect_hit, &hits );
+  assertEqual( hits, "" );
+  // the classic example, with overlapping matches
+  Tries::UniTrie<trie_info> ac;
+  ac.Store( "he", new trie_info( 1 ) );
+  ac.Store( "she", new trie_info( 2 ) );
+  ac.Store( "his", new trie_info( 3 ) );
+  ac.Store( "hers", new trie_info( 4 ) );
+  ac.freeze();
+  ac.find_all( "ushers", collect_hit, &hits );
+  assertEqual( hits, "2:1:3 1:2:2 4:2:4 " );
 }
 
 void test_base_dir(){
@@ -883,6 +1482,312 @@ void test_logstream( const string& path ){
   assertEqual( system( cmd.c_str() ), 0 );
 }
 
+void test_async_logstream( const string& path ){
+  {
+    // async mode gives the same output as the normal mode
+    ofstream uit( "/tmp/testls.2" );
+    LogStream ls( uit );
+    ls.set_stamp( NoStamp );
+    assertTrue( ls.set_async_mode() );
+    assertTrue( ls.async() );
+    *Log( ls ) << "test 1 level=" << ls.get_level() << " threshold="
+	       << ls.get_threshold() << endl;
+    *Dbg( ls ) << "debug 1" << endl;
+    ls.set_level( LogSilent );
+    *Log( ls ) << "test 2 level=" << ls.get_level() << " threshold="
+	       << ls.get_threshold() << endl;
+    ls.set_level( LogDebug );
+    *Log( ls ) << "test 3 level=" << ls.get_level() << " threshold="
+	       << ls.get_threshold() << endl;
+    *Dbg( ls ) << "debug 3" << endl;
+    *xDbg( ls ) << "x_debug 3" << endl;
+    ls.set_level( LogExtreme );
+    *Log( ls ) << "test 4 level=" << ls.get_level() << " threshold="
+	       << ls.get_threshold() << endl;
+    *Dbg( ls ) << "debug 4" << endl;
+    *xDbg( ls ) << "x_debug 4" << endl;
+    *xxDbg( ls ) << "xx_debug 4" << endl;
+    ls.set_level( LogHeavy );
+    *Log( ls ) << "test 5 level=" << ls.get_level() << " threshold="
+	       << ls.get_threshold() << endl;
+    ls.add_message( "AHA:" );
+    ls.set_stamp( StampMessage );
+    *Dbg( ls ) << "debug 5" << endl;
+    *xDbg( ls ) << "x_debug 5" << endl;
+    *xxDbg( ls ) << "xx_debug 5" << endl;
+  }
+  string cmd = "diff /tmp/testls.2 " + path + "testls.1.ok";
+  assertEqual( system( cmd.c_str() ), 0 );
+  ofstream uit( "/tmp/testls.3" );
+  LogStream ls( uit );
+  ls.set_stamp( NoStamp );
+  assertTrue( ls.set_async_mode() );
+  LogStream child( &ls );
+  assertTrue( child.async() );
+  const int lines = 2000;
+#pragma omp parallel for
+  for ( int i=0; i < lines; ++i ){
+    *Log( ls ) << "line " << i << endl;
+    *Dbg( ls ) << "invisible " << i << endl;
+    Log outer( child );
+    *outer << "child ";
+    *Log( child ) << i;
+    *outer << endl;
+  }
+  ls.async_flush();
+  uit.close();
+  ifstream in( "/tmp/testls.3" );
+  vector<bool> seen( lines, false );
+  vector<bool> child_seen( lines, false );
+  int bad = 0;
+  string line;
+  while ( getline( in, line ) ){
+    vector<string> parts = split( line );
+    int i = -1;
+    if ( parts.size() != 2
+	 || !stringTo( parts[1], i )
+	 || i < 0 || i >= lines ){
+      ++bad;
+    }
+    else if ( parts[0] == "line" ){
+      seen[i] = true;
+    }
+    else if ( parts[0] == "child" ){
+      child_seen[i] = true;
+    }
+    else {
+      ++bad;
+    }
+  }
+  assertEqual( bad, 0 );
+  assertEqual( count( seen.begin(), seen.end(), true ), lines );
+  assertEqual( count( child_seen.begin(), child_seen.end(), true ), lines );
+  assertTrue( ls.set_async_mode( false ) );
+  assertFalse( ls.async() );
+  // a nested scope doesn't cut a record in two, not even when another
+  // thread logs in between
+  ostringstream nested;
+  LogStream ns( nested );
+  ns.set_stamp( NoStamp );
+  assertTrue( ns.set_async_mode() );
+  {
+    Log outer( ns );
+    *outer << "outer ";
+    *Log( ns ) << "inner ";
+    // a scope on the stream handed out, as helper functions do
+    *Log( *outer ) << "helper";
+    std::thread other( [&]{ *Log( ns ) << "other" << endl; } );
+    other.join();
+    *outer << endl;
+  }
+  ns.async_flush();
+  assertEqual( nested.str(), "other\nouter inner helper\n" );
+  // and no lock is left behind: LogStreams in normal mode still work
+  ostringstream normal;
+  LogStream nls( normal );
+  nls.set_stamp( NoStamp );
+  std::thread other( [&]{ *Log( nls ) << "normal" << endl; } );
+  other.join();
+  assertEqual( normal.str(), "normal\n" );
+  // destroying an async LogStream inside a scope of a normal one
+  ostringstream async_out;
+  LogStream owner( async_out );
+  owner.set_stamp( NoStamp );
+  assertTrue( owner.set_async_mode() );
+  {
+    Log log( nls );
+    *log << "scope";
+    {
+      LogStream child( &owner );
+      assertTrue( child.async() );
+      *Log( child ) << "child" << endl;
+    }
+    assertThrow( owner.async_flush(), logic_error );
+    *log << endl;
+  }
+  owner.async_flush();
+  assertEqual( async_out.str(), "child\n" );
+  assertEqual( normal.str(), "normal\nscope\n" );
+}
+
+int evaluations = 0;
+int evaluate(){
+  return ++evaluations;
+}
+
+void test_log_macros(){
+  ostringstream uit;
+  LogStream ls( uit );
+  ls.set_stamp( NoStamp );
+  assertTrue( IsActive( ls, LogNormal ) );
+  assertFalse( IsActive( ls, LogDebug ) );
+  assertFalse( IsActive( (LogStream*)0, LogNormal ) );
+  TICC_LOG( ls ) << "log " << evaluate() << endl;
+  TICC_DBG( ls ) << "debug " << evaluate() << endl;
+  TICC_XDBG( &ls ) << "x_debug " << evaluate() << endl;
+  TICC_XXDBG( ls ) << "xx_debug " << evaluate() << endl;
+  assertEqual( evaluations, 1 );
+  ls.set_level( LogHeavy );
+  assertTrue( IsActive( &ls, LogHeavy ) );
+  if ( evaluations > 0 )
+    TICC_DBG( ls ) << "debug " << evaluate() << endl;
+  TICC_XDBG( &ls ) << "x_debug " << evaluate() << endl;
+  TICC_XXDBG( ls ) << "xx_debug " << evaluate() << endl;
+  assertEqual( evaluations, 3 );
+  // an inactive scope doesn't disturb an active one
+  {
+    Log log( ls );
+    *log << "outer ";
+    *xxDbg( ls ) << "inner";
+    *Dbg( ls ) << "dbg ";
+    *log << "end" << endl;
+  }
+  ls.set_level( LogSilent );
+  TICC_LOG( ls ) << "log " << evaluate() << endl;
+  *Log( ls ) << "silent" << endl;
+  assertEqual( evaluations, 3 );
+  assertEqual( uit.str(), "log 1\ndebug 2\nx_debug 3\nouter dbg end\n" );
+  // inactive scopes of different threads don't share a stream
+  LogStream *mine = &*Dbg( ls );
+  LogStream *other = 0;
+  std::thread t( [&](){ other = &*Dbg( ls ); } );
+  t.join();
+  assertTrue( mine != other );
+  assertTrue( mine == &*xDbg( ls ) );
+}
+
+void test_log_buffer(){
+  ostringstream uit;
+  LogStream ls( uit );
+  ls.set_stamp( NoStamp );
+  *Log( ls ) << "een\r\ntwee" << '\r' << string( "\rdrie\r" ) << endl;
+  assertEqual( uit.str(), "een\ntweedrie\n" );
+  uit.str( "" );
+  ls.set_stamp( StampBoth );
+  ls.set_message( "mess" );
+  *Log( ls ) << "stamped " << 42 << endl;
+  *Log( ls ) << "again" << endl;
+  vector<string> lines = split_at( uit.str(), "\n" );
+  assertEqual( lines.size(), 2 );
+  UnicodeRegexMatcher stamp( "^\\d{8}:\\d{6}:\\d{3}:mess:(.*)$" );
+  UnicodeString pre;
+  UnicodeString post;
+  assertTrue( stamp.match_all( UnicodeFromUTF8( lines[0] ), pre, post ) );
+  assertEqual( stamp.get_match( 0 ), "stamped 42" );
+  assertTrue( stamp.match_all( UnicodeFromUTF8( lines[1] ), pre, post ) );
+  assertEqual( stamp.get_match( 0 ), "again" );
+  string ts = time_stamp();
+  assertEqual( ts.size(), 20 );
+  char buf[64];
+  assertEqual( time_stamp( buf ), 20 );
+  assertEqual( string( buf, 9 ), ts.substr( 0, 9 ) );
+}
+
+void test_structured_logging(){
+  using namespace nlohmann;
+  set_log_ring_size( 4 );
+  ostringstream uit;
+  LogStream ls( uit );
+  ls.set_message( "tst" );
+  assertTrue( ls.set_format( LogJson ) );
+  assertEqual( ls.get_format(), LogJson );
+  *Log( ls ) << "hello " << 1 << endl;
+  *Dbg( ls ) << "hidden" << endl;
+  ls.set_level( LogDebug );
+  *Dbg( ls ) << "say \"hi\"" << endl;
+  vector<string> lines = split_at( uit.str(), "\n" );
+  assertEqual( lines.size(), 2 );
+  json j1 = json::parse( lines[0] );
+  json j2 = json::parse( lines[1] );
+  assertEqual( j1["level"], "normal" );
+  assertEqual( j1["message"], "hello 1" );
+  assertEqual( j1["prefix"], "tst" );
+  assertEqual( j2["level"], "debug" );
+  assertEqual( j2["message"], "say \"hi\"" );
+  assertEqual( j1["thread"], j2["thread"] );
+  assertTrue( j1["time"].get<uint64_t>() <= j2["time"].get<uint64_t>() );
+  // binary records
+  uit.str( "" );
+  assertTrue( ls.set_format( LogBinary ) );
+  *Log( ls ) << "binary" << endl;
+  string rec = uit.str();
+  uint32_t len = 0;
+  memcpy( &len, rec.data(), 4 );
+  assertEqual( len + 4, rec.size() );
+  assertEqual( int(rec[4]), int(LogNormal) );
+  uint16_t prefix_len = 0;
+  memcpy( &prefix_len, rec.data() + 17, 2 );
+  assertEqual( prefix_len, 3 );
+  assertEqual( rec.substr( 19 ), "tstbinary" );
+  // only in the ring buffer
+  uit.str( "" );
+  assertTrue( ls.set_format( LogRingOnly ) );
+  for ( int i=0; i < 6; ++i ){
+    *Log( ls ) << "ring " << i << endl;
+  }
+  assertTrue( uit.str().empty() );
+  ostringstream dump;
+  dump_log_rings( dump );
+  // the ring keeps the last 4 records
+  lines = split_at( dump.str(), "\n" );
+  assertEqual( lines.size(), 4 );
+  assertEqual( json::parse( lines[0] )["message"], "ring 2" );
+  assertEqual( json::parse( lines[3] )["message"], "ring 5" );
+  // structured and async
+  assertTrue( ls.set_format( LogJson ) );
+  assertTrue( ls.set_async_mode() );
+  const int records = 500;
+#pragma omp parallel for
+  for ( int i=0; i < records; ++i ){
+    *Log( ls ) << "record " << i << endl;
+  }
+  ls.async_flush();
+  lines = split_at( uit.str(), "\n" );
+  assertEqual( lines.size(), records );
+  int bad = 0;
+  for ( const auto& line : lines ){
+    json j = json::parse( line );
+    if ( j["message"].get<string>().find( "record " ) != 0 ){
+      ++bad;
+    }
+  }
+  assertEqual( bad, 0 );
+  assertTrue( ls.set_async_mode( false ) );
+  assertTrue( ls.set_format( LogText ) );
+  set_log_ring_size( 1024 );
+}
+
+void test_crash_handler(){
+  // crash in a child process, so the handler isn't installed here
+  const string crash_file = "/tmp/crash.log";
+  pid_t pid = fork();
+  if ( pid == 0 ){
+    int fd = open( crash_file.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644 );
+    if ( fd < 0 || dup2( fd, 2 ) < 0 ){
+      _exit( 1 );
+    }
+    ostringstream uit;
+    LogStream ls( uit );
+    ls.set_message( "child" );
+    ls.set_format( LogRingOnly );
+    *Log( ls ) << "last words" << endl;
+    if ( !install_log_crash_handler() ){
+      _exit( 1 );
+    }
+    abort();
+  }
+  assertTrue( pid > 0 );
+  int status = 0;
+  assertEqual( waitpid( pid, &status, 0 ), pid );
+  assertTrue( WIFSIGNALED( status ) );
+  assertEqual( WTERMSIG( status ), SIGABRT );
+  ifstream is( crash_file );
+  string dump( (istreambuf_iterator<char>( is )), istreambuf_iterator<char>() );
+  assertTrue( dump.find( "fatal signal" ) != string::npos );
+  assertTrue( dump.find( "\"message\":\"last words\"" ) != string::npos );
+  assertTrue( dump.find( "\"prefix\":\"child\"" ) != string::npos );
+}
+
 void test_unicode( const string& path ){
   UChar32 uc0 = L'私';
   UnicodeString u1 = uc0;
@@ -1052,6 +1957,148 @@ void test_unicode_regex( ){
   assertEqual( result, "VVD" );
 }
 
+UnicodeString span_string( const UnicodeString& us,
+			   const UnicodeRegexMatcher::span& s ){
+  return UnicodeString( us, s.first, s.second - s.first );
+}
+
+bool same_regex_split( UnicodeRegexMatcher& matcher,
+		       const UnicodeString& line ){
+  vector<UnicodeString> parts;
+  vector<UnicodeRegexMatcher::span> spans;
+  int n1 = matcher.split( line, parts );
+  int n2 = matcher.split( line, spans );
+  bool same = ( n1 == n2 );
+  for ( int i=0; same && i < n1; ++i ){
+    same = ( parts[i] == span_string( line, spans[i] ) );
+  }
+  if ( !same ){
+    cerr << "split of '" << line << "' on " << matcher.Pattern()
+	 << " differs" << endl;
+  }
+  return same;
+}
+
+void test_unicode_regex_offsets(){
+  UnicodeRegexMatcher test2( "(?:de|het|een)_(\\p{Lu}+)(?:-(?:\\p{L}*)|\\Z)",
+			     "test2" );
+  UnicodeString us = "zie een_CDA-minister praten";
+  vector<UnicodeRegexMatcher::span> results;
+  UnicodeRegexMatcher::span pre;
+  UnicodeRegexMatcher::span post;
+  assertTrue( test2.match_offsets( us, results, pre, post ) );
+  assertEqual( results.size(), 1 );
+  assertEqual( span_string( us, results[0] ), "CDA" );
+  assertEqual( span_string( us, pre ), "zie een_" );
+  assertEqual( span_string( us, post ), "-minister praten" );
+  UnicodeString upre;
+  UnicodeString upost;
+  assertTrue( test2.match_all( us, upre, upost ) );
+  assertEqual( upre, span_string( us, pre ) );
+  assertEqual( upost, span_string( us, post ) );
+  assertFalse( test2.match_offsets( "niets", results, pre, post ) );
+  assertTrue( results.empty() );
+  UnicodeRegexMatcher mail( "(\\w+)@(\\w+)\\.(nl|com)", "mail" );
+  assertTrue( mail.match_offsets( "mail piet@ru.nl nu", results, pre, post ) );
+  assertEqual( results.size(), 4 );
+  assertEqual( span_string( "mail piet@ru.nl nu", results[0] ), "piet@ru.nl" );
+  assertEqual( span_string( "mail piet@ru.nl nu", results[3] ), "nl" );
+  vector<UnicodeString> lines = { "", "a", "a b  c", "  a b ", "a-b--c-",
+				  "-", "x,y;z", ",,", "geen scheiding" };
+  vector<UnicodeString> patterns = { "\\s+", "-", "(-)", "(,)|(;)", "\\d*" };
+  for ( const auto& pat : patterns ){
+    UnicodeRegexMatcher matcher( pat );
+    for ( const auto& line : lines ){
+      assertTrue( same_regex_split( matcher, line ) );
+    }
+  }
+  UnicodeRegexMatcher spaces( "\\s+" );
+  vector<UnicodeRegexMatcher::span> spans;
+  assertEqual( spaces.split( "een twee  drie", spans ), 3 );
+  assertEqual( span_string( "een twee  drie", spans[2] ), "drie" );
+  // more than the 256 parts the UnicodeString variant can handle
+  UnicodeString many;
+  for ( int i=0; i < 1000; ++i ){
+    many += "w ";
+  }
+  assertEqual( spaces.split( many, spans ), 1001 );
+  // one matcher, used by several threads
+  vector<UnicodeString> words( 2000 );
+  for ( size_t i=0; i < words.size(); ++i ){
+    words[i] = "zie een_CDA-minister" + toUnicodeString( i );
+  }
+  atomic<int> errors( 0 );
+#pragma omp parallel for
+  for ( size_t i=0; i < words.size(); ++i ){
+    vector<UnicodeRegexMatcher::span> res;
+    UnicodeRegexMatcher::span p;
+    UnicodeRegexMatcher::span q;
+    if ( !test2.match_offsets( words[i], res, p, q )
+	 || span_string( words[i], res[0] ) != "CDA"
+	 || spaces.split( words[i], res ) != 2 ){
+      ++errors;
+    }
+  }
+  assertEqual( errors.load(), 0 );
+}
+
+bool same_split( const vector<UnicodeString>& parts,
+		 const UnicodeString& line,
+		 const vector<UnicodeSpan>& spans ){
+  bool same = ( parts.size() == spans.size() );
+  for ( size_t i=0; same && i < parts.size(); ++i ){
+    same = ( parts[i] == span_string( line, spans[i] ) );
+  }
+  if ( !same ){
+    cerr << "split of '" << line << "' differs" << endl;
+  }
+  return same;
+}
+
+void test_unicode_split_spans(){
+  UnicodeString smiley = UnicodeString( UChar32(0x1F600) );
+  vector<UnicodeString> lines = { "", " ", "a", "a b  c", "  a b ",
+				  "a-b--c-", "--", "een\ttwee\r\ndrie ",
+				  "x" + smiley + "y" + smiley + smiley + "z" };
+  vector<UnicodeSpan> spans;
+  for ( const auto& line : lines ){
+    for ( size_t max=0; max < 5; ++max ){
+      assertEqual( split( line, spans, max ), split( line, max ).size() );
+      assertTrue( same_split( split( line, max ), line, spans ) );
+      split_at( line, "-", spans, max );
+      assertTrue( same_split( split_at( line, "-", max ), line, spans ) );
+      split_at_first_of( line, UnicodeCharSet( " -" ), spans, max );
+      assertTrue( same_split( split_at_first_of( line, " -", max ),
+			      line, spans ) );
+    }
+    split_exact_at( line, "-", spans );
+    assertTrue( same_split( split_exact_at( line, "-" ), line, spans ) );
+    split_exact_at_first_of( line, UnicodeCharSet( " -" ), spans );
+    assertTrue( same_split( split_exact_at_first_of( line, " -" ),
+			    line, spans ) );
+  }
+  UnicodeString line = lines.back();
+  assertEqual( split_at_first_of( line, UnicodeCharSet( smiley ), spans ), 3 );
+  assertEqual( span_string( line, spans[1] ), "y" );
+  assertEqual( split_exact_at_first_of( line, UnicodeCharSet( smiley ),
+					spans ), 4 );
+  assertTrue( spans[2].first == spans[2].second );
+  assertEqual( split_exact_at( line, smiley, spans ), 4 );
+  // a lone surrogate half is no match for a pair
+  UnicodeString lead( smiley[0] );
+  assertEqual( split_at_first_of( line, UnicodeCharSet( lead ), spans ), 1 );
+  UnicodeCharSet set( "aé" + smiley );
+  assertTrue( set.contains( 'a' ) );
+  assertTrue( set.contains( 0xE9 ) );
+  assertTrue( set.contains( 0x1F600 ) );
+  assertFalse( set.contains( 'b' ) );
+  assertFalse( set.contains( 0xFFFF ) );
+  assertFalse( set.contains( 0x1F601 ) );
+  assertThrow( split_at( line, "", spans ), runtime_error );
+  assertThrow( split_at_first_of( line, UnicodeCharSet( "" ), spans ),
+	       runtime_error );
+}
+
 void test_unicode_filters( const string& path ){
   UniFilter filt;
   assertNoThrow( filt.init( "‘ > \\' ; ’ > \\' ;  \\` > \\' ; ´ > \\' ;",
@@ -1092,6 +2139,292 @@ void test_unicode_filters( const string& path ){
   assertEqual( filter_diacritics( "de reeën zijn reeël" ), "de reeen zijn reeel" );
 }
 
+UnicodeString reference_normalize( const UnicodeString& us,
+				   const string& mode ){
+  // straight ICU normalization, as UnicodeNormalizer used to do
+  UErrorCode err = U_ZERO_ERROR;
+  const Normalizer2 *norm = 0;
+  if ( mode == "NFC" ){
+    norm = Normalizer2::getNFCInstance( err );
+  }
+  else if ( mode == "NFD" ){
+    norm = Normalizer2::getNFDInstance( err );
+  }
+  else if ( mode == "NFKC" ){
+    norm = Normalizer2::getNFKCInstance( err );
+  }
+  else if ( mode == "NFKD" ){
+    norm = Normalizer2::getNFKDInstance( err );
+  }
+  if ( norm == 0 ){
+    return us;
+  }
+  return norm->normalize( us, err );
+}
+
+bool same_unicode_conversions( const vector<string>& inputs ){
+  bool same = true;
+  for ( const string mode : { "NFC", "NFD", "NFKC", "NFKD", "NONE" } ){
+    for ( const auto& in : inputs ){
+      UnicodeString ref = reference_normalize( UnicodeString::fromUTF8( in ),
+					       mode );
+      string ref8;
+      ref.toUTF8String( ref8 );
+      UnicodeString latin( in.c_str(), in.length(), "ISO-8859-1" );
+      latin = reference_normalize( latin, mode );
+      if ( UnicodeFromUTF8( in, mode ) != ref
+	   || UnicodeFromEnc( in, "UTF8", mode ) != ref
+	   || UnicodeFromEnc( in, "utf-8", mode ) != ref
+	   || UnicodeFromEnc( in, "ISO-8859-1", mode ) != latin
+	   || UnicodeToUTF8( UnicodeString::fromUTF8( in ), mode ) != ref8 ){
+	cerr << "conversion of '" << in << "' in mode " << mode
+	     << " differs" << endl;
+	same = false;
+      }
+    }
+  }
+  return same;
+}
+
+void test_unicode_conversions(){
+  vector<string> inputs = { "", "a", "simple ASCII text, longer than 8",
+			    "appe\xCC\x81l", "appél", "Καλημέρα κόσμε",
+			    "ﬁnal ﬂow ①", "bad \xC3( utf8", "truncated \xF0\x9F",
+			    "\xEF\xBB\xBF" "bom", "こんにちは", "e\xCC\x81" };
+  assertTrue( same_unicode_conversions( inputs ) );
+  // the caches are per thread
+  atomic<int> errors( 0 );
+#pragma omp parallel for
+  for ( int i=0; i < 64; ++i ){
+    if ( !same_unicode_conversions( inputs ) ){
+      ++errors;
+    }
+  }
+  assertEqual( errors.load(), 0 );
+  assertThrow( UnicodeFromUTF8( "appel", "NFX" ), logic_error );
+  assertThrow( UnicodeToUTF8( "appel", "NFX" ), logic_error );
+  UnicodeString nfd = UnicodeFromUTF8( "appél", "NFD" );
+  assertEqual( nfd.length(), 6 );
+  assertEqual( UnicodeFromUTF8( "appe\xCC\x81l" ).length(), 5 );
+  assertEqual( UnicodeFromEnc( "caf\xE9", "ISO-8859-1" ),
+	       UnicodeFromUTF8( "café" ) );
+  assertThrow( UnicodeFromEnc( "appel", "no-such-encoding" ),
+	       invalid_argument );
+  UnicodeNormalizer un;
+  UnicodeString us = "appel";
+  assertEqual( un.normalize( us ), us );
+  assertEqual( un.normalize( nfd ), UnicodeFromUTF8( "appél" ) );
+  un.normalize_inplace( nfd );
+  assertEqual( nfd.length(), 5 );
+}
+
+bool same_stream_normalization( const string& text, const string& mode ){
+  string expected = UnicodeToUTF8( UnicodeFromUTF8( text, mode ), mode );
+  UnicodeNormalizer un( mode );
+  string buffer_result;
+  un.normalize( text, buffer_result );
+  istringstream is1( text );
+  ostringstream os1;
+  un.normalize( is1, os1 );
+  istringstream is2( text );
+  ostringstream os2;
+  un.normalize_parallel( is2, os2 );
+  if ( buffer_result != expected
+       || os1.str() != expected
+       || os2.str() != expected ){
+    cerr << "stream normalization differs for mode " << mode
+	 << " on a text of " << text.size() << " bytes" << endl;
+    return false;
+  }
+  return true;
+}
+
+void test_stream_normalization(){
+  string text;
+  int i = 0;
+  while ( text.size() < 5*1024*1024 ){
+    switch ( i++ % 7 ){
+    case 0: text += "appe\xCC\x81l "; break;
+    case 1: text += "Καλημέρα κόσμε\n"; break;
+    case 2: text += "ﬁnal ﬂow ① "; break;
+    case 3: text += "o\xCC\x88\xCC\xA3\xCC\x81 "; break;
+    case 4: text += "bad \xC3( \xF0\x9F"; break;
+    case 5: text += "\xE1\x84\x80\xE1\x85\xA1 "; break; // Hangul jamo
+    default: text += "gewoon wat tekst, " + toString( i ) + "\n";
+    }
+  }
+  for ( const string mode : { "NFC", "NFD", "NFKC", "NFKD", "NONE" } ){
+    assertTrue( same_stream_normalization( text, mode ) );
+  }
+  // a combining sequence much longer than a chunk, crossing the borders
+  string marks = string( 500000, 'x' ) + "e";
+  for ( int j=0; j < 700000; ++j ){
+    marks += "\xCC\x81";
+  }
+  marks += " klaar";
+  assertTrue( same_stream_normalization( marks, "NFC" ) );
+  assertTrue( same_stream_normalization( "", "NFC" ) );
+  assertTrue( same_stream_normalization( "e\xCC\x81", "NFC" ) );
+}
+
+bool same_lines( const string& input,
+		 const string& encoding,
+		 char delim = '\n' ){
+  // compare UnicodeLineReader with TiCC::getline()
+  istringstream is1( input );
+  istringstream is2( input );
+  UnicodeLineReader reader( is2, encoding, "NFC", delim );
+  UnicodeString line1;
+  UnicodeString line2;
+  size_t count = 0;
+  while ( true ){
+    bool ok1 = bool( TiCC::getline( is1, line1, encoding, delim ) );
+    bool ok2 = reader.getline( line2 );
+    if ( ok1 != ok2
+	 || ( ok1 && line1 != line2 ) ){
+      cerr << "line " << count << " differs: " << ok1 << ",'" << line1
+	   << "' versus " << ok2 << ",'" << line2 << "'" << endl;
+      return false;
+    }
+    if ( !ok1 ){
+      return reader.eof();
+    }
+    ++count;
+  }
+}
+
+void test_line_reader(){
+  vector<string> inputs = { "", "\n", "\n\n", "a", "a\n", "a\nb",
+			    "a\nb\n", "\na\n\nb\n\n", "een\r\ntwee\r\n",
+			    "appe\xCC\x81l\npe\xCC\x88" "er\n",
+			    "bad \xC3( utf8\ntruncated \xF0\x9F\n\xF0\x9F",
+			    "\xEF\xBB\xBF" "bom\n", "Καλημέρα κόσμε\nこんにちは\n" };
+  string big( 200000, 'x' );
+  inputs.push_back( big + "\n" + big );
+  string many;
+  for ( int i=0; i < 30000; ++i ){
+    many += "regel " + toString( i ) + " met é\n";
+  }
+  inputs.push_back( many );
+  for ( const auto& in : inputs ){
+    assertTrue( same_lines( in, "UTF8" ) );
+    assertTrue( same_lines( in, "utf-8", ';' ) );
+  }
+  assertTrue( same_lines( "caf\xE9\nna\xEF" "ef\n", "ISO-8859-1" ) );
+  assertTrue( same_lines( many, "ISO-8859-1" ) );
+  istringstream is( "appe\xCC\x81l;peer" );
+  UnicodeLineReader reader( is, "UTF8", "NFC", ';' );
+  UnicodeString line;
+  assertTrue( reader.getline( line ) );
+  assertEqual( line, UnicodeString( "appél" ) );
+  assertEqual( line.length(), 5 );
+  assertFalse( reader.eof() );
+  assertTrue( reader.getline( line ) );
+  assertEqual( line, UnicodeString( "peer" ) );
+  assertTrue( reader.eof() );
+  assertFalse( reader.getline( line ) );
+  assertEqual( line, UnicodeString( "" ) );
+  istringstream is2( "appe\xCC\x81l" );
+  UnicodeLineReader reader2( is2, "UTF8", "NFD" );
+  assertTrue( reader2.getline( line ) );
+  assertEqual( line.length(), 6 );
+  assertThrow( UnicodeLineReader( is2, "no-such-encoding" ), runtime_error );
+}
+
+void test_unifilter_lazy( const string& path ){
+  UniFilter batch;
+  UnicodeString all_rules;
+  for ( int i=0; i < 200; ++i ){
+    // no rule may mask another
+    UnicodeString rule = "x" + toUnicodeString( i ) + "x > y"
+      + toUnicodeString( i ) + " ;";
+    assertTrue( batch.add( rule ) );
+    all_rules += rule;
+  }
+  assertTrue( batch.is_initialized() );
+  UniFilter single;
+  assertNoThrow( single.init( all_rules, "single" ) );
+  UnicodeString line = "x7x x13x x199x z1";
+  assertEqual( batch.filter( line ), single.filter( line ) );
+  assertEqual( batch.filter( line ), "y7 y13 y199 z1" );
+  assertNoThrow( batch.add( string( "z y" ) ) );
+  assertEqual( batch.filter( line ), "y7 y13 y199 y1" );
+  // errors in added rules show up on first use
+  UniFilter bad;
+  assertNoThrow( bad.init( "a > b ;", "bad" ) );
+  assertNoThrow( bad.add( UnicodeString( "[ > c ;" ) ) );
+  assertThrow( bad.filter( "a" ), runtime_error );
+  // and keep showing up
+  assertThrow( bad.filter( "a" ), runtime_error );
+  assertThrow( bad.get_rules(), runtime_error );
+  assertThrow( bad.init( "a > b ;", "bad" ), logic_error );
+  // the same file twice uses the cached compiled rules
+  UniFilter f1;
+  UniFilter f2;
+  assertNoThrow( f1.fill( path + "quotes.filter" ) );
+  assertNoThrow( f2.fill( path + "quotes.filter" ) );
+  assertEqual( f1.get_rules(), f2.get_rules() );
+  UnicodeString vies = "`vies´ en ‘smerig’";
+  assertEqual( f1.filter( vies ), f2.filter( vies ) );
+}
+
+void test_parallel_filters(){
+  UniFilter filt;
+  assertNoThrow( filt.init( "[:Hyphen:]+ > '-'; [:Dash:]+ > '-'; é > e ;",
+			    "hyphen_filter" ) );
+  vector<UnicodeString> lines;
+  for ( int i=0; i < 5000; ++i ){
+    lines.push_back( "regel " + toUnicodeString( i )
+		     + " em—dash, appél, reeën, 3em⸻dash" );
+  }
+  vector<UnicodeString> serial;
+  vector<UnicodeString> serial_diacritics;
+  for ( const auto& line : lines ){
+    serial.push_back( filt.filter( line ) );
+    serial_diacritics.push_back( filter_diacritics( line ) );
+  }
+  assertEqual( serial[3], "regel 3 em-dash, appel, reeën, 3em-dash" );
+  atomic<int> errors( 0 );
+#pragma omp parallel for
+  for ( size_t i=0; i < lines.size(); ++i ){
+    if ( filt.filter( lines[i] ) != serial[i]
+	 || filter_diacritics( lines[i] ) != serial_diacritics[i] ){
+      ++errors;
+    }
+  }
+  assertEqual( errors.load(), 0 );
+  vector<UnicodeString> batch = lines;
+  filt.filter_batch( batch );
+  assertTrue( batch == serial );
+  batch = lines;
+  filter_diacritics_batch( batch );
+  assertTrue( batch == serial_diacritics );
+  // adding rules invalidates the clones
+  assertNoThrow( filt.add( string( "regel line" ) ) );
+  batch = lines;
+  filt.filter_batch( batch );
+  assertEqual( batch[3], "line 3 em-dash, appel, reeën, 3em-dash" );
+  // the worker threads keep their clones for the next batch
+  vector<UnicodeString> again = lines;
+  filt.filter_batch( again );
+  assertTrue( again == batch );
+  errors = 0;
+#pragma omp parallel for
+  for ( size_t i=0; i < lines.size(); ++i ){
+    if ( filt.filter( lines[i] ) != batch[i] ){
+      ++errors;
+    }
+  }
+  assertEqual( errors.load(), 0 );
+  UniFilter empty;
+  batch = lines;
+  empty.filter_batch( batch );
+  assertTrue( batch == lines );
+  UniFilter bad;
+  assertNoThrow( bad.add( UnicodeString( "[ > c ;" ) ) );
+  assertThrow( bad.filter_batch( batch ), runtime_error );
+}
+
 void test_conversion(){
   int i = 8;
   double d = 3.14;
@@ -1124,6 +2457,177 @@ bool faal(){
   throw runtime_error( "I failed it" );
 }
 
+template <typename T>
+bool stream_stringTo( const string& str, T& result ){
+  // the reference: how stringTo() always worked
+  T tmp;
+  stringstream ss( str );
+  if ( ss >> tmp ){
+    result = tmp;
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool same_conversion( const vector<string>& inputs ){
+  bool same = true;
+  for ( const auto& in : inputs ){
+    T v1{};
+    T v2{};
+    bool ok1 = stringTo( in, v1 );
+    bool ok2 = stream_stringTo( in, v2 );
+    if ( ok1 != ok2 || ( ok1 && !( v1 == v2 ) ) ){
+      cerr << "stringTo<" << typeid(T).name() << ">( '" << in
+	   << "' ) differs: " << ok1 << "," << v1 << " versus "
+	   << ok2 << "," << v2 << endl;
+      same = false;
+    }
+  }
+  return same;
+}
+
+// a type with its own stringTo(), and no operator>>
+enum class Metric { L, M };
+
+namespace TiCC {
+  template<>
+  Metric stringTo<Metric>( const string& s ){
+    if ( s == "L" ){
+      return Metric::L;
+    }
+    else if ( s == "M" ){
+      return Metric::M;
+    }
+    throw runtime_error( "no metric: " + s );
+  }
+}
+
+void test_fast_conversion(){
+  vector<string> inputs = { "0", "8", "-8", "+8", "+-8", "-+8", "++8", "- 8",
+			    " \t\n42", "42 ", "42abc", "abc", "", " ", "+",
+			    "-", "007", "0x1F", "1e5", "1e", "1e+", "1E-3x",
+			    "1.5", ".5", "-.5", "+.5", ".", "-.", "1.", "1.e3",
+			    "inf", "-inf", "nan", "INF", "infinity",
+			    "2147483647", "2147483648", "-2147483648",
+			    "-2147483649", "4294967295", "4294967296",
+			    "9223372036854775807", "9223372036854775808",
+			    "18446744073709551616", "65535", "65536",
+			    "-32768", "-32769", "1e999", "-1e999", "1e-400",
+			    "4e-320", "3.4028236e38", "0.1", "3.14159265358979",
+			    "123456789012345678901234567890" };
+  assertTrue( same_conversion<int>( inputs ) );
+  assertTrue( same_conversion<unsigned int>( inputs ) );
+  assertTrue( same_conversion<short>( inputs ) );
+  assertTrue( same_conversion<unsigned short>( inputs ) );
+  assertTrue( same_conversion<long>( inputs ) );
+  assertTrue( same_conversion<long long>( inputs ) );
+  assertTrue( same_conversion<unsigned long long>( inputs ) );
+  assertTrue( same_conversion<float>( inputs ) );
+  assertTrue( same_conversion<double>( inputs ) );
+  assertTrue( same_conversion<long double>( inputs ) );
+  assertTrue( same_conversion<char>( inputs ) );
+  assertTrue( same_conversion<string>( inputs ) );
+  int i = 0;
+  assertTrue( stringTo( "12", i ) );
+  assertEqual( i, 12 );
+  string_view sv = "123456";
+  assertTrue( stringTo( sv.substr( 1, 2 ), i ) );
+  assertEqual( i, 23 );
+  assertFalse( stringTo( "twaalf", i ) );
+  assertEqual( i, 23 );
+  assertTrue( stringTo( string( "40" ), i, 0, 50 ) );
+  assertFalse( stringTo( string( "60" ), i, 0, 50 ) );
+  assertFalse( stringTo( string( "x" ), i, 0, 50 ) );
+  assertEqual( i, 40 );
+  bool b = false;
+  assertTrue( stringTo( "yes", b ) );
+  assertTrue( b );
+  assertFalse( stringTo( "misschien", b ) );
+  assertThrow( stringTo<bool>( string( "misschien" ) ), runtime_error );
+  // specializations of stringTo<T>() are used
+  Metric m = Metric::L;
+  assertTrue( stringTo( string( "M" ), m ) );
+  assertTrue( m == Metric::M );
+  assertFalse( stringTo( string( "X" ), m ) );
+  assertTrue( m == Metric::M );
+  assertTrue( stringTo( string( "L" ), m, Metric::L, Metric::M ) );
+  assertTrue( m == Metric::L );
+}
+
+template <typename T>
+string stream_toString( const T& val ){
+  // the reference: how toString() always worked
+  stringstream ss;
+  ss << val;
+  return ss.str();
+}
+
+template <typename T>
+bool same_formatting( const vector<T>& values ){
+  bool same = true;
+  for ( const auto& val : values ){
+    string s1 = toString( val );
+    string s2 = stream_toString( val );
+    string s3 = "<";
+    append_to_string( s3, val );
+    UnicodeString us = toUnicodeString( val );
+    if ( s1 != s2 || s3 != "<" + s2 || UnicodeToUTF8( us ) != s2 ){
+      cerr << "toString<" << typeid(T).name() << ">( " << s2
+	   << " ) differs: '" << s1 << "', '" << s3 << "', '" << us
+	   << "'" << endl;
+      same = false;
+    }
+  }
+  return same;
+}
+
+template <typename T>
+vector<T> int_samples(){
+  return { T(0), T(1), T(7), T(42), T(100), numeric_limits<T>::min(),
+	   numeric_limits<T>::max(), T(numeric_limits<T>::max()/3) };
+}
+
+template <typename T>
+vector<T> float_samples(){
+  return { T(0), -T(0), T(1), T(-1), T(0.1), T(3.14), T(-2.5), T(1e5),
+	   T(1e6), T(123456), T(1234567), T(1e-4), T(1e-5), T(1)/T(3),
+	   T(2)/T(3), T(1e21), T(-1e-30), numeric_limits<T>::max(),
+	   numeric_limits<T>::lowest(), numeric_limits<T>::min(),
+	   numeric_limits<T>::denorm_min(), numeric_limits<T>::epsilon(),
+	   numeric_limits<T>::infinity(), -numeric_limits<T>::infinity(),
+	   numeric_limits<T>::quiet_NaN() };
+}
+
+void test_fast_formatting(){
+  assertTrue( same_formatting( int_samples<int>() ) );
+  assertTrue( same_formatting( int_samples<unsigned int>() ) );
+  assertTrue( same_formatting( int_samples<short>() ) );
+  assertTrue( same_formatting( int_samples<unsigned short>() ) );
+  assertTrue( same_formatting( int_samples<long>() ) );
+  assertTrue( same_formatting( int_samples<long long>() ) );
+  assertTrue( same_formatting( int_samples<unsigned long long>() ) );
+  assertTrue( same_formatting( float_samples<float>() ) );
+  assertTrue( same_formatting( float_samples<double>() ) );
+  assertTrue( same_formatting( float_samples<long double>() ) );
+  assertTrue( same_formatting( vector<bool>{ true, false } ) );
+  assertTrue( same_formatting( vector<char>{ 'a', '7' } ) );
+  assertTrue( same_formatting( vector<string>{ "", "appel" } ) );
+  assertEqual( toString( 3.5 ), "3.5" );
+  assertEqual( toString( -12 ), "-12" );
+  assertEqual( toString( 1e100 ), "1e+100" );
+  string out = "x=";
+  append_to_string( out, 12 );
+  append_to_string( out, ' ' );
+  append_to_string( out, 0.25 );
+  assertEqual( out, "x=12 0.25" );
+  vector<int> iv = { 1, -2, 300 };
+  assertEqual( join( iv, ", " ), UnicodeString( "1, -2, 300" ) );
+  vector<double> dv = { 0.5, 1e-7 };
+  assertEqual( join( dv ), UnicodeString( "0.5 1e-07" ) );
+  assertEqual( join( vector<int>() ), UnicodeString( "" ) );
+}
+
 void test_assert() {
   assertTrue( faal() );
 }
@@ -1296,6 +2800,7 @@ int main( const int argc, const char* argv[] ){
   test_trim_front();
   test_trim_back();
   test_pad();
+  test_inplace();
   test_match_front();
   test_match_back();
   test_format_non_printable();
@@ -1305,11 +2810,20 @@ int main( const int argc, const char* argv[] ){
   test_split_at_exact();
   test_split_at_first();
   test_split_at_first_exact();
+  test_split_view();
+  test_string_kernels();
   test_to_upper();
   test_to_lower();
   test_uppercase();
   test_lowercase();
   test_unicodehash();
+  test_unicodehash_batch();
+  test_utf8hash();
+  test_unicodehash_snapshot();
+  test_concurrent_unicodehash();
+  test_unitrie();
+  test_parallel_unitrie();
+  test_unitrie_snapshot();
   test_realpath();
   test_ncname();
   string testdir;
@@ -1322,6 +2836,11 @@ int main( const int argc, const char* argv[] ){
   test_configuration( testdir );
   test_pretty_print();
   test_logstream( testdir );
+  test_async_logstream( testdir );
+  test_log_macros();
+  test_log_buffer();
+  test_structured_logging();
+  test_crash_handler();
   test_unicode( testdir );
   test_unicode_split();
   test_unicode_split_exact();
@@ -1331,8 +2850,17 @@ int main( const int argc, const char* argv[] ){
   test_unicode_split_at_first_exact();
   test_unicode_trim();
   test_unicode_regex();
+  test_unicode_regex_offsets();
+  test_unicode_split_spans();
   test_unicode_filters( testdir );
+  test_unifilter_lazy( testdir );
+  test_parallel_filters();
+  test_unicode_conversions();
+  test_line_reader();
+  test_stream_normalization();
   test_conversion();
+  test_fast_conversion();
+  test_fast_formatting();
   test_assert();
   test_json();
   test_enum_flags();